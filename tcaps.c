@@ -1,6 +1,8 @@
 /* Copyright ttyio (C) by Alex Eski 2025 */
 /* Licensed under GPLv3, see LICENSE for more information. */
 
+#include <limits.h>
+#include <stdlib.h>
 #include <string.h> // used by macros cap_New && cap_New_Lit
 
 #include "lib/unibilium.h"
@@ -37,6 +39,8 @@ extern unibi_term* uterm;
 #define FB_GOTO_BOL "\r"
 
 #define FB_COLOR_RESET "\033[0m" /* Colors */
+#define FB_COLOR_RGB_SET "\033[38;2;%p1%d;%p2%d;%p3%dm"
+#define FB_COLOR_RGB_BG_SET "\033[48;2;%p1%d;%p2%d;%p3%dm"
 
 // capability macros
 #define cap_New(s, t)                                                                                                  \
@@ -69,6 +73,21 @@ do {
         cap = cap_New(str, t);                                                                                         \
 } while(0)
 
+// Parameterized caps are compiled once so they don't have to be parsed on every use
+#define tcaps_set_parm(str, cap, t)                                                                                    \
+do {                                                                                                                   \
+    if (str && *str) {                                                                                                 \
+        cap = cap_New(str, t);                                                                                         \
+        cap.prog = tparm_compile(str);                                                                                 \
+    }                                                                                                                  \
+} while(0)
+
+/* Nearest palette color for RGB colors on terminals with less than 256 colors, 5 bits per channel.
+ * Entries are the palette index + 1, filled in the first time they are used.
+ */
+#define TCAPS_RGB_LUT_SIZE (32 * 32 * 32)
+static unsigned char* tcaps_rgb_lut__;
+
 void tcaps_init(void)
 {
     tcaps_init_opts(true);
@@ -76,17 +95,38 @@ void tcaps_init(void)
 
 void tcaps_init_opts(bool init_advanced_caps)
 {
+    tcaps_deinit();
     tcaps = (termcaps){0};
     tcaps_init_keys();
     tcaps_init_scr();
     tcaps_init_cursor();
     tcaps_init_line();
     tcaps_init_colors();
+    tcaps_init_attrs();
+    tcaps_init_sync();
     if (init_advanced_caps) {
         tcaps_init_goto_prev_eol();
     }
 }
 
+void tcaps_deinit(void)
+{
+    cap* parm_caps[] = {&tcaps.cursor_pos,       &tcaps.cursor_left_n,    &tcaps.cursor_right_n,
+                        &tcaps.cursor_up_n,      &tcaps.cursor_down_n,    &tcaps.col_address,
+                        &tcaps.row_address,      &tcaps.line_erase_chars, &tcaps.line_del_chars,
+                        &tcaps.color_set,        &tcaps.color_bg_set,     &tcaps.attr_set,
+                        &tcaps.color_rgb_set,    &tcaps.color_rgb_bg_set, &tcaps.scroll_region,
+                        &tcaps.scroll_forward_n, &tcaps.scroll_reverse_n, &tcaps.line_ins_chars,
+                        &tcaps.line_insert_n,    &tcaps.line_delete_n,    &tcaps.line_repeat_char};
+    for (size_t i = 0; i < sizeof(parm_caps) / sizeof(parm_caps[0]); ++i) {
+        tparm_free(parm_caps[i]->prog);
+        parm_caps[i]->prog = NULL;
+    }
+
+    free(tcaps_rgb_lut__);
+    tcaps_rgb_lut__ = NULL;
+}
+
 void tcaps_init_keys(void)
 {
     // TODO: backspace currently only uses the fallback, investigate using unibi cap.
@@ -119,6 +159,25 @@ void tcaps_init_scr(void)
 
     const char* scr_clr_to_eos = unibi_get_str(uterm, unibi_clr_eos);
     tcaps_set(scr_clr_to_eos, tcaps.scr_clr_to_eos, FB_CLR_SCR_TO_EOS, CAP_SCR_CLR_TO_EOS);
+
+    tcaps.auto_right_margin = unibi_get_bool(uterm, unibi_auto_right_margin);
+    tcaps.eat_newline_glitch = unibi_get_bool(uterm, unibi_eat_newline_glitch);
+    tcaps.back_color_erase = unibi_get_bool(uterm, unibi_back_color_erase);
+
+    const char* region = unibi_get_str(uterm, unibi_change_scroll_region);
+    tcaps_set_parm(region, tcaps.scroll_region, CAP_SCROLL_REGION);
+
+    const char* forward = unibi_get_str(uterm, unibi_scroll_forward);
+    tcaps_set_no_fb(forward, tcaps.scroll_forward, CAP_SCROLL_FORWARD);
+
+    const char* reverse = unibi_get_str(uterm, unibi_scroll_reverse);
+    tcaps_set_no_fb(reverse, tcaps.scroll_reverse, CAP_SCROLL_REVERSE);
+
+    const char* forward_n = unibi_get_str(uterm, unibi_parm_index);
+    tcaps_set_parm(forward_n, tcaps.scroll_forward_n, CAP_SCROLL_FORWARD_N);
+
+    const char* reverse_n = unibi_get_str(uterm, unibi_parm_rindex);
+    tcaps_set_parm(reverse_n, tcaps.scroll_reverse_n, CAP_SCROLL_REVERSE_N);
 }
 
 void tcaps_init_cursor(void)
@@ -151,13 +210,25 @@ void tcaps_init_cursor(void)
     tcaps_set(cursor_show, tcaps.cursor_show, FB_CURSOR_SHOW, CAP_CURSOR_SHOW);
 
     const char* cursor_pos = unibi_get_str(uterm, unibi_cursor_address);
-    tcaps_set_no_fb(cursor_pos, tcaps.cursor_pos, CAP_CURSOR_POS);
+    tcaps_set_parm(cursor_pos, tcaps.cursor_pos, CAP_CURSOR_POS);
 
     const char* col_address = unibi_get_str(uterm, unibi_column_address);
-    tcaps_set_no_fb(col_address, tcaps.col_address, CAP_COL_ADDRESS);
+    tcaps_set_parm(col_address, tcaps.col_address, CAP_COL_ADDRESS);
 
     const char* row_address = unibi_get_str(uterm, unibi_row_address);
-    tcaps_set_no_fb(row_address, tcaps.row_address, CAP_ROW_ADDRESS);
+    tcaps_set_parm(row_address, tcaps.row_address, CAP_ROW_ADDRESS);
+
+    const char* left_n = unibi_get_str(uterm, unibi_parm_left_cursor);
+    tcaps_set_parm(left_n, tcaps.cursor_left_n, CAP_CURSOR_LEFT_N);
+
+    const char* right_n = unibi_get_str(uterm, unibi_parm_right_cursor);
+    tcaps_set_parm(right_n, tcaps.cursor_right_n, CAP_CURSOR_RIGHT_N);
+
+    const char* up_n = unibi_get_str(uterm, unibi_parm_up_cursor);
+    tcaps_set_parm(up_n, tcaps.cursor_up_n, CAP_CURSOR_UP_N);
+
+    const char* down_n = unibi_get_str(uterm, unibi_parm_down_cursor);
+    tcaps_set_parm(down_n, tcaps.cursor_down_n, CAP_CURSOR_DOWN_N);
 }
 
 void tcaps_init_line(void)
@@ -170,6 +241,36 @@ void tcaps_init_line(void)
 
     const char* goto_bol = unibi_get_str(uterm, unibi_carriage_return);
     tcaps_set(goto_bol, tcaps.line_goto_bol, FB_GOTO_BOL, CAP_LINE_GOTO_BOL);
+
+    const char* erase_chars = unibi_get_str(uterm, unibi_erase_chars);
+    tcaps_set_parm(erase_chars, tcaps.line_erase_chars, CAP_LINE_ERASE_CHARS);
+
+    const char* del_chars = unibi_get_str(uterm, unibi_parm_dch);
+    tcaps_set_parm(del_chars, tcaps.line_del_chars, CAP_LINE_DEL_CHARS);
+
+    const char* del_char = unibi_get_str(uterm, unibi_delete_character);
+    tcaps_set_no_fb(del_char, tcaps.line_del_char, CAP_LINE_DEL_CHAR);
+
+    const char* ins_chars = unibi_get_str(uterm, unibi_parm_ich);
+    tcaps_set_parm(ins_chars, tcaps.line_ins_chars, CAP_LINE_INS_CHARS);
+
+    const char* ins_char = unibi_get_str(uterm, unibi_insert_character);
+    tcaps_set_no_fb(ins_char, tcaps.line_ins_char, CAP_LINE_INS_CHAR);
+
+    const char* insert_n = unibi_get_str(uterm, unibi_parm_insert_line);
+    tcaps_set_parm(insert_n, tcaps.line_insert_n, CAP_LINE_INSERT_N);
+
+    const char* insert = unibi_get_str(uterm, unibi_insert_line);
+    tcaps_set_no_fb(insert, tcaps.line_insert, CAP_LINE_INSERT);
+
+    const char* delete_n = unibi_get_str(uterm, unibi_parm_delete_line);
+    tcaps_set_parm(delete_n, tcaps.line_delete_n, CAP_LINE_DELETE_N);
+
+    const char* delete = unibi_get_str(uterm, unibi_delete_line);
+    tcaps_set_no_fb(delete, tcaps.line_delete, CAP_LINE_DELETE);
+
+    const char* repeat_char = unibi_get_str(uterm, unibi_repeat_char);
+    tcaps_set_parm(repeat_char, tcaps.line_repeat_char, CAP_LINE_REPEAT_CHAR);
 }
 
 void tcaps_init_colors(void)
@@ -180,10 +281,248 @@ void tcaps_init_colors(void)
     tcaps_set(reset, tcaps.color_reset, FB_COLOR_RESET, CAP_COLOR_RESET);
 
     const char* color_set = unibi_get_str(uterm, unibi_set_a_foreground);
-    tcaps_set_no_fb(color_set, tcaps.color_set, CAP_COLOR_SET);
+    tcaps_set_parm(color_set, tcaps.color_set, CAP_COLOR_SET);
 
     const char* color_bg_set = unibi_get_str(uterm, unibi_set_a_background);
-    tcaps_set_no_fb(color_bg_set, tcaps.color_bg_set, CAP_COLOR_BG_SET);
+    tcaps_set_parm(color_bg_set, tcaps.color_bg_set, CAP_COLOR_BG_SET);
+
+    const char* color_default = unibi_get_str(uterm, unibi_orig_pair);
+    tcaps_set_no_fb(color_default, tcaps.color_default, CAP_COLOR_DEFAULT);
+
+    tcaps_init_colors_rgb();
+}
+
+static bool tcaps_ext_name__(const char* restrict name, const char* restrict ext_name)
+{
+    return ext_name && !strcmp(name, ext_name);
+}
+
+/* Extended caps aren't in the standard terminfo tables, look them up by name */
+static const char* tcaps_ext_str__(const char* restrict name)
+{
+    for (size_t i = 0; i < unibi_count_ext_str(uterm); ++i) {
+        if (tcaps_ext_name__(name, unibi_get_ext_str_name(uterm, i)))
+            return unibi_get_ext_str(uterm, i);
+    }
+    return NULL;
+}
+
+static bool tcaps_ext_flag__(const char* restrict name)
+{
+    for (size_t i = 0; i < unibi_count_ext_bool(uterm); ++i) {
+        if (tcaps_ext_name__(name, unibi_get_ext_bool_name(uterm, i)))
+            return unibi_get_ext_bool(uterm, i);
+    }
+    // ncurses also allows RGB to be a number or a string
+    for (size_t i = 0; i < unibi_count_ext_num(uterm); ++i) {
+        if (tcaps_ext_name__(name, unibi_get_ext_num_name(uterm, i)))
+            return unibi_get_ext_num(uterm, i) > 0;
+    }
+    const char* str = tcaps_ext_str__(name);
+    return str && *str;
+}
+
+/* Sync takes 1 to begin and 2 to end an update, expanded once at init since it never changes */
+static char tcaps_sync_begin__[32];
+static char tcaps_sync_end__[32];
+
+void tcaps_init_sync(void)
+{
+    const char* sync = tcaps_ext_str__("Sync");
+    if (!sync || !*sync)
+        return;
+
+    size_t begin = unibi_run(sync, (unibi_var_t[9]){[0] = unibi_var_from_num(1)}, tcaps_sync_begin__,
+                             sizeof(tcaps_sync_begin__));
+    size_t end = unibi_run(sync, (unibi_var_t[9]){[0] = unibi_var_from_num(2)}, tcaps_sync_end__,
+                           sizeof(tcaps_sync_end__));
+    if (!begin || begin >= sizeof(tcaps_sync_begin__) || !end || end >= sizeof(tcaps_sync_end__))
+        return;
+    tcaps.sync_begin = cap_New_s(tcaps_sync_begin__, begin, CAP_SYNC_BEGIN);
+    tcaps.sync_end = cap_New_s(tcaps_sync_end__, end, CAP_SYNC_END);
+}
+
+void tcaps_init_colors_rgb(void)
+{
+    const char* rgb_set = tcaps_ext_str__("setrgbf");
+    const char* rgb_bg_set = tcaps_ext_str__("setrgbb");
+    const char* colorterm = getenv("COLORTERM");
+    tcaps.color_rgb = (rgb_set && rgb_bg_set) || tcaps_ext_flag__("RGB") || tcaps_ext_flag__("Tc") ||
+                      (colorterm && (!strcmp(colorterm, "truecolor") || !strcmp(colorterm, "24bit")));
+    if (!tcaps.color_rgb)
+        return;
+
+    if (!rgb_set || !rgb_bg_set) {
+        rgb_set = FB_COLOR_RGB_SET;
+        rgb_bg_set = FB_COLOR_RGB_BG_SET;
+    }
+    tcaps_set_parm(rgb_set, tcaps.color_rgb_set, CAP_COLOR_RGB_SET);
+    tcaps_set_parm(rgb_bg_set, tcaps.color_rgb_bg_set, CAP_COLOR_RGB_BG_SET);
+}
+
+static inline int tcaps_rgb_dist__(int r1, int g1, int b1, int r2, int g2, int b2)
+{
+    return (r1 - r2) * (r1 - r2) + (g1 - g2) * (g1 - g2) + (b1 - b2) * (b1 - b2);
+}
+
+/* xterm's 256 color palette: 16 system colors, a 6x6x6 color cube, then 24 grays.
+ * Both the cube and the grays are evenly spaced, so the nearest of each can be found arithmetically.
+ */
+static int tcaps_rgb_to_256__(int r, int g, int b)
+{
+    static const int cube[6] = {0x00, 0x5f, 0x87, 0xaf, 0xd7, 0xff};
+#define tcaps_cube_index__(v) ((v) < 48 ? 0 : (v) < 115 ? 1 : ((v) - 35) / 40)
+    int qr = tcaps_cube_index__(r);
+    int qg = tcaps_cube_index__(g);
+    int qb = tcaps_cube_index__(b);
+#undef tcaps_cube_index__
+    int cube_color = 16 + 36 * qr + 6 * qg + qb;
+    int cr = cube[qr];
+    int cg = cube[qg];
+    int cb = cube[qb];
+    if (cr == r && cg == g && cb == b)
+        return cube_color;
+
+    int avg = (r + g + b) / 3;
+    int gray_index = avg > 238 ? 23 : avg < 3 ? 0 : (avg - 3) / 10;
+    int gray = 8 + 10 * gray_index;
+    if (tcaps_rgb_dist__(gray, gray, gray, r, g, b) < tcaps_rgb_dist__(cr, cg, cb, r, g, b))
+        return 232 + gray_index;
+    return cube_color;
+}
+
+/* 88 color terminals use a 4x4x4 cube and 8 grays after the 16 system colors */
+static int tcaps_rgb_to_88__(int r, int g, int b)
+{
+    static const int cube[4] = {0x00, 0x8b, 0xcd, 0xff};
+#define tcaps_cube_index__(v) ((v) < 70 ? 0 : (v) < 172 ? 1 : (v) < 230 ? 2 : 3)
+    int qr = tcaps_cube_index__(r);
+    int qg = tcaps_cube_index__(g);
+    int qb = tcaps_cube_index__(b);
+#undef tcaps_cube_index__
+    int cube_color = 16 + 16 * qr + 4 * qg + qb;
+
+    static const int grays[8] = {0x2e, 0x5c, 0x73, 0x8b, 0xa2, 0xb9, 0xd0, 0xe7};
+    int avg = (r + g + b) / 3;
+    int gray_index = 0;
+    while (gray_index < 7 && avg > (grays[gray_index] + grays[gray_index + 1]) / 2) {
+        ++gray_index;
+    }
+    int gray = grays[gray_index];
+    if (tcaps_rgb_dist__(gray, gray, gray, r, g, b) < tcaps_rgb_dist__(cube[qr], cube[qg], cube[qb], r, g, b))
+        return 80 + gray_index;
+    return cube_color;
+}
+
+/* The system colors have no pattern, so their nearest colors are searched once and cached in a table */
+static int tcaps_rgb_to_system__(int r, int g, int b, int colors)
+{
+    static const unsigned char system[16][3] = {
+        {0x00, 0x00, 0x00}, {0xcd, 0x00, 0x00}, {0x00, 0xcd, 0x00}, {0xcd, 0xcd, 0x00},
+        {0x00, 0x00, 0xee}, {0xcd, 0x00, 0xcd}, {0x00, 0xcd, 0xcd}, {0xe5, 0xe5, 0xe5},
+        {0x7f, 0x7f, 0x7f}, {0xff, 0x00, 0x00}, {0x00, 0xff, 0x00}, {0xff, 0xff, 0x00},
+        {0x5c, 0x5c, 0xff}, {0xff, 0x00, 0xff}, {0x00, 0xff, 0xff}, {0xff, 0xff, 0xff}};
+
+    if (!tcaps_rgb_lut__) {
+        tcaps_rgb_lut__ = calloc(TCAPS_RGB_LUT_SIZE, 1);
+        if (!tcaps_rgb_lut__)
+            return 0;
+    }
+
+    size_t key = (size_t)((r >> 3) << 10 | (g >> 3) << 5 | (b >> 3));
+    if (tcaps_rgb_lut__[key])
+        return tcaps_rgb_lut__[key] - 1;
+
+    // search from the middle of the bucket
+    r = (r & 0xf8) | 4;
+    g = (g & 0xf8) | 4;
+    b = (b & 0xf8) | 4;
+    int best = 0;
+    int best_dist = INT_MAX;
+    for (int i = 0; i < colors; ++i) {
+        // weighted by the mean red, closer to how different colors look than plain distance
+        int rmean = (system[i][0] + r) / 2;
+        int dr = system[i][0] - r;
+        int dg = system[i][1] - g;
+        int db = system[i][2] - b;
+        int dist = ((512 + rmean) * dr * dr >> 8) + 4 * dg * dg + ((767 - rmean) * db * db >> 8);
+        if (dist < best_dist) {
+            best = i;
+            best_dist = dist;
+        }
+    }
+    tcaps_rgb_lut__[key] = (unsigned char)(best + 1);
+    return best;
+}
+
+int tcaps_color_rgb_to_palette(unsigned char r, unsigned char g, unsigned char b)
+{
+    if (tcaps.color_max >= 256)
+        return tcaps_rgb_to_256__(r, g, b);
+    if (tcaps.color_max >= 88)
+        return tcaps_rgb_to_88__(r, g, b);
+    if (tcaps.color_max >= 16)
+        return tcaps_rgb_to_system__(r, g, b, 16);
+    if (tcaps.color_max >= 8)
+        return tcaps_rgb_to_system__(r, g, b, 8);
+    return -1;
+}
+
+void tcaps_init_attrs(void)
+{
+    const char* bold = unibi_get_str(uterm, unibi_enter_bold_mode);
+    tcaps_set_no_fb(bold, tcaps.attr_bold, CAP_ATTR_BOLD);
+
+    const char* dim = unibi_get_str(uterm, unibi_enter_dim_mode);
+    tcaps_set_no_fb(dim, tcaps.attr_dim, CAP_ATTR_DIM);
+
+    const char* italic = unibi_get_str(uterm, unibi_enter_italics_mode);
+    tcaps_set_no_fb(italic, tcaps.attr_italic, CAP_ATTR_ITALIC);
+
+    const char* underline = unibi_get_str(uterm, unibi_enter_underline_mode);
+    tcaps_set_no_fb(underline, tcaps.attr_underline, CAP_ATTR_UNDERLINE);
+
+    const char* reverse = unibi_get_str(uterm, unibi_enter_reverse_mode);
+    tcaps_set_no_fb(reverse, tcaps.attr_reverse, CAP_ATTR_REVERSE);
+
+    const char* italic_off = unibi_get_str(uterm, unibi_exit_italics_mode);
+    tcaps_set_no_fb(italic_off, tcaps.attr_italic_off, CAP_ATTR_ITALIC_OFF);
+
+    const char* underline_off = unibi_get_str(uterm, unibi_exit_underline_mode);
+    tcaps_set_no_fb(underline_off, tcaps.attr_underline_off, CAP_ATTR_UNDERLINE_OFF);
+
+    const char* set = unibi_get_str(uterm, unibi_set_attributes);
+    tcaps_set_parm(set, tcaps.attr_set, CAP_ATTR_SET);
+}
+
+const char* tcaps_color_get(int color, bool bg, size_t* restrict len)
+{
+    if (color < 0 || color >= TCAPS_COLOR_TABLE_MAX || color >= tcaps.color_max)
+        return NULL;
+
+    color_table__* table = &tcaps.color_table;
+    color_seq__* seq = bg ? &table->bg[color] : &table->fg[color];
+    if (seq->len) {
+        *len = seq->len;
+        return table->buf + seq->offset;
+    }
+
+    const cap* c = bg ? &tcaps.color_bg_set : &tcaps.color_set;
+    if (!c->len)
+        return NULL;
+
+    char* dest = table->buf + table->len;
+    size_t avail = sizeof(table->buf) - table->len;
+    size_t n = c->prog ? tparm_run(c->prog, &color, 1, dest, avail)
+                       : unibi_run(c->val, (unibi_var_t[9]){[0] = unibi_var_from_num(color)}, dest, avail);
+    if (!n || n >= avail || n > UCHAR_MAX)
+        return NULL;
+
+    seq->offset = (unsigned short)table->len;
+    seq->len = (unsigned char)n;
+    table->len += n;
+    *len = n;
+    return dest;
 }
 
 void tcaps_init_goto_prev_eol(void)
@@ -9,6 +9,7 @@
 #include <stddef.h>
 #include <stdio.h>
 
+#include "tparm.h"
 #include "ttyplatform.h" // used for including stdbool in cases its needed
 
 #ifdef __cplusplus
@@ -24,6 +25,13 @@ enum caps {
 
     CAP_SCR_CLR,
     CAP_SCR_CLR_TO_EOS,
+    CAP_SCROLL_REGION,      // set the scroll region, top and bottom rows
+    CAP_SCROLL_FORWARD,     // scroll the region up a line, cursor on the bottom row of the region
+    CAP_SCROLL_REVERSE,     // scroll the region down a line, cursor on the top row of the region
+    CAP_SCROLL_FORWARD_N,
+    CAP_SCROLL_REVERSE_N,
+    CAP_SYNC_BEGIN,         // start a synchronized update, the terminal holds off drawing until it ends
+    CAP_SYNC_END,
 
     CAP_CURSOR_HOME,
     CAP_CURSOR_LEFT,
@@ -35,14 +43,40 @@ enum caps {
     CAP_CURSOR_SAVE,
     CAP_CURSOR_RESTORE,
     CAP_CURSOR_POS,         // set cursor position
+    CAP_CURSOR_LEFT_N,      // move cursor left n cells
+    CAP_CURSOR_RIGHT_N,
+    CAP_CURSOR_UP_N,
+    CAP_CURSOR_DOWN_N,
 
     CAP_LINE_CLR_TO_EOL,
     CAP_LINE_CLR_TO_BOL,
     CAP_LINE_GOTO_BOL,      // i.e. carriage return
+    CAP_LINE_ERASE_CHARS,   // erase n chars, cursor doesn't move
+    CAP_LINE_DEL_CHARS,     // delete n chars, shifting the rest of the line left
+    CAP_LINE_DEL_CHAR,
+    CAP_LINE_INS_CHARS,     // insert n blank chars, shifting the rest of the line right
+    CAP_LINE_INS_CHAR,
+    CAP_LINE_INSERT_N,      // insert n blank lines at the cursor's line, shifting the lines below down
+    CAP_LINE_INSERT,
+    CAP_LINE_DELETE_N,      // delete n lines starting at the cursor's line, shifting the lines below up
+    CAP_LINE_DELETE,
+    CAP_LINE_REPEAT_CHAR,   // write a char n times
 
     CAP_COLOR_RESET,
     CAP_COLOR_SET,
     CAP_COLOR_BG_SET,
+    CAP_COLOR_DEFAULT,      // set foreground and background to the default colors
+    CAP_COLOR_RGB_SET,      // set a 24-bit foreground color
+    CAP_COLOR_RGB_BG_SET,
+
+    CAP_ATTR_BOLD,
+    CAP_ATTR_DIM,
+    CAP_ATTR_ITALIC,
+    CAP_ATTR_UNDERLINE,
+    CAP_ATTR_REVERSE,
+    CAP_ATTR_ITALIC_OFF,
+    CAP_ATTR_UNDERLINE_OFF,
+    CAP_ATTR_SET,           // set all attributes at once, resets colors on most terminals
 
     CAP_COL_ADDRESS,        // sets the column position
     CAP_ROW_ADDRESS,        // sets the row position
@@ -57,6 +91,7 @@ typedef struct {
     enum caps type;
     size_t len;
     const char* val;
+    tparm* prog; // compiled val for parameterized caps, NULL if not compiled
 } cap;
 
 // Advanced caps can use multiple fallbacks that must be handled by functions in ttyio.
@@ -65,6 +100,24 @@ typedef struct {
     enum advanced_caps__ type;
 } advanced_cap__;
 
+/* Number of colors cached in the color table, colors past this are expanded on every use */
+#define TCAPS_COLOR_TABLE_MAX 256
+#define TCAPS_COLOR_TABLE_BUF_SIZE (TCAPS_COLOR_TABLE_MAX * 2 * 16)
+
+// Color sequences are expanded from terminfo on first use and cached, so setting a color is a lookup and a memcpy.
+// A len of 0 means not expanded yet.
+typedef struct {
+    unsigned short offset;
+    unsigned char len;
+} color_seq__;
+
+typedef struct {
+    size_t len;
+    color_seq__ fg[TCAPS_COLOR_TABLE_MAX];
+    color_seq__ bg[TCAPS_COLOR_TABLE_MAX];
+    char buf[TCAPS_COLOR_TABLE_BUF_SIZE];
+} color_table__;
+
 typedef struct {
     cap bs; /* Keys */
     cap del;
@@ -74,6 +127,16 @@ typedef struct {
 
     cap scr_clr; /* Screen */
     cap scr_clr_to_eos;
+    bool auto_right_margin;  // cursor wraps to the next line after writing to the last column
+    bool eat_newline_glitch; // wrap is delayed until the next char is written
+    bool back_color_erase;   // erasing fills with the current background color
+    cap scroll_region;       /* Scrolling, len is 0 if not supported */
+    cap scroll_forward;
+    cap scroll_reverse;
+    cap scroll_forward_n;
+    cap scroll_reverse_n;
+    cap sync_begin; /* Synchronized output, from the Sync extended cap. len is 0 if not in terminfo. */
+    cap sync_end;
 
     cap cursor_home; /* Cursor */
     cap cursor_left;
@@ -85,16 +148,44 @@ typedef struct {
     cap cursor_save;
     cap cursor_restore;
     cap cursor_pos;
+    cap cursor_left_n; /* Parameterized cursor movement, len is 0 if not supported */
+    cap cursor_right_n;
+    cap cursor_up_n;
+    cap cursor_down_n;
 
     cap line_clr_to_eol; /* Line */
     cap line_clr_to_bol;
     cap line_goto_bol;
+    cap line_erase_chars; /* len is 0 if not supported */
+    cap line_del_chars;
+    cap line_del_char;
+    cap line_ins_chars;
+    cap line_ins_char;
+    cap line_insert_n;
+    cap line_insert;
+    cap line_delete_n;
+    cap line_delete;
+    cap line_repeat_char;
     advanced_cap__ line_goto_prev_eol;
 
     int color_max; /* Colors */
     cap color_reset;
     cap color_set;
     cap color_bg_set;
+    cap color_default; /* len is 0 if not supported */
+    bool color_rgb;    /* supports 24-bit color, from the RGB or Tc extended caps or COLORTERM */
+    cap color_rgb_set;
+    cap color_rgb_bg_set;
+    color_table__ color_table;
+
+    cap attr_bold; /* Attributes, len is 0 if not supported */
+    cap attr_dim;
+    cap attr_italic;
+    cap attr_underline;
+    cap attr_reverse;
+    cap attr_italic_off;
+    cap attr_underline_off;
+    cap attr_set;
 
     cap col_address;
     cap row_address;
@@ -104,6 +195,8 @@ typedef struct {
 void tcaps_init(void);
 /* Init all caps but can exclude advanced caps like line_goto_prev_eol */
 void tcaps_init_opts(bool init_advanced_caps);
+/* Free memory used by compiled parameterized caps */
+void tcaps_deinit(void);
 
 /* Specific caps initialization */
 void tcaps_init_keys(void);
@@ -111,6 +204,17 @@ void tcaps_init_scr(void);
 void tcaps_init_cursor(void);
 void tcaps_init_line(void);
 void tcaps_init_colors(void);
+void tcaps_init_colors_rgb(void);
+void tcaps_init_attrs(void);
+void tcaps_init_sync(void);
+
+/* Get the sequence to set the foreground (or background if bg) color, from the color table.
+ * Returns NULL if the color can't be cached, then it has to be expanded from color_set or color_bg_set.
+ */
+const char* tcaps_color_get(int color, bool bg, size_t* restrict len);
+
+/* Nearest color in the terminal's palette (256, 88, 16 or 8 colors) to an RGB color. Returns -1 without colors. */
+int tcaps_color_rgb_to_palette(unsigned char r, unsigned char g, unsigned char b);
 
 /* Advanced cap initiailization */
 void tcaps_init_goto_prev_eol(void);
@@ -0,0 +1,272 @@
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif /* ifndef _POSIX_C_SOURCE */
+#ifndef _XOPEN_SOURCE
+#define _XOPEN_SOURCE 700
+#endif /* ifndef _XOPEN_SOURCE */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../lib/unibilium.h"
+#include "../tparm.h"
+#include "../ttyio.h"
+#include "../ttyscreen.h"
+
+/* bench: microbenchmarks for ttyio internals, run with `make bench && ./bench` */
+
+#define ITERATIONS 1000000
+
+static volatile size_t sink;
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static double bench_unibi_run(const cap* c)
+{
+    char buf[64];
+    double start = now_ns();
+    for (int i = 0; i < ITERATIONS; ++i) {
+        unibi_var_t params[9] = {[0] = unibi_var_from_num(i & 255), [1] = unibi_var_from_num(i & 127)};
+        sink += unibi_run(c->val, params, buf, sizeof buf);
+    }
+    return (now_ns() - start) / ITERATIONS;
+}
+
+static double bench_tparm_run(const cap* c)
+{
+    char buf[64];
+    double start = now_ns();
+    for (int i = 0; i < ITERATIONS; ++i) {
+        int params[2] = {i & 255, i & 127};
+        sink += tparm_run(c->prog, params, 2, buf, sizeof buf);
+    }
+    return (now_ns() - start) / ITERATIONS;
+}
+
+/* Compare the terminfo interpreter to compiled caps */
+static void tparm_bench(const char* name, const cap* c)
+{
+    if (!c->len || !c->prog) {
+        printf("%-16s not supported by this terminal\n", name);
+        return;
+    }
+
+    char expected[64];
+    char actual[64];
+    unibi_var_t params[9] = {[0] = unibi_var_from_num(42), [1] = unibi_var_from_num(7)};
+    size_t expected_len = unibi_run(c->val, params, expected, sizeof expected);
+    size_t actual_len = tparm_run(c->prog, (int[2]){42, 7}, 2, actual, sizeof actual);
+    if (expected_len != actual_len || memcmp(expected, actual, expected_len)) {
+        printf("%-16s output doesn't match unibi_run\n", name);
+        return;
+    }
+
+    double interpreted = bench_unibi_run(c);
+    double compiled = bench_tparm_run(c);
+    printf("%-16s unibi_run %6.1f ns/op, tparm_run %6.1f ns/op, %4.1fx\n", name, interpreted, compiled,
+           interpreted / compiled);
+}
+
+/* Nearest palette color for RGB colors, cycling through colors so the 16 color table is filled as it goes */
+static void rgb_bench(const char* name, int colors)
+{
+    int color_max = tcaps.color_max;
+    tcaps.color_max = colors;
+    double start = now_ns();
+    for (int i = 0; i < ITERATIONS; ++i) {
+        unsigned char r = (unsigned char)(i * 7);
+        unsigned char g = (unsigned char)(i >> 3);
+        unsigned char b = (unsigned char)(i >> 11);
+        sink += (size_t)tcaps_color_rgb_to_palette(r, g, b);
+    }
+    printf("%-16s %6.1f ns/op\n", name, (now_ns() - start) / ITERATIONS);
+    tcaps.color_max = color_max;
+}
+
+/* tty_present when nothing changed, with rows untouched and with every row drawn again with the same content */
+static void screen_bench(void)
+{
+    // present writes to stdout, keep it out of the results
+    fflush(stdout);
+    int out = dup(STDOUT_FILENO);
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+
+    tty_screen_init();
+    Coordinates size = tty_screen_size();
+    tty_style style = {.fg = 2, .bg = TTY_COLOR_DEFAULT};
+    for (size_t y = 0; y < size.y; ++y) {
+        tty_screen_print(0, y, style, "the quick brown fox jumps over the lazy dog");
+    }
+    tty_present();
+
+    int iterations = ITERATIONS / 100;
+    double start = now_ns();
+    for (int i = 0; i < iterations; ++i) {
+        tty_present();
+    }
+    double clean = (now_ns() - start) / iterations;
+
+    start = now_ns();
+    for (int i = 0; i < iterations; ++i) {
+        tty_screen_clear();
+        for (size_t y = 0; y < size.y; ++y) {
+            tty_screen_print(0, y, style, "the quick brown fox jumps over the lazy dog");
+        }
+        tty_present();
+    }
+    double redrawn = (now_ns() - start) / iterations;
+    tty_screen_deinit();
+
+    dup2(out, STDOUT_FILENO);
+    close(out);
+    close(null);
+    printf("%-16s %zux%zu, untouched %8.1f ns/op, redrawn %8.1f ns/op\n", "present", size.x, size.y, clean, redrawn);
+}
+
+static void writeln_bench(void)
+{
+    // unbuffered writes to /dev/null, so the syscalls are what is measured
+    fflush(stdout);
+    int out = dup(STDOUT_FILENO);
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+
+    const char line[] = "the quick brown fox jumps over the lazy dog";
+    int iterations = ITERATIONS / 10;
+    double start = now_ns();
+    for (int i = 0; i < iterations; ++i) {
+        tty_write(line, sizeof(line) - 1);
+        tty_send(&tcaps.newline);
+    }
+    double separate = (now_ns() - start) / iterations;
+
+    start = now_ns();
+    for (int i = 0; i < iterations; ++i) {
+        tty_writeln(line, sizeof(line) - 1);
+    }
+    double vectored = (now_ns() - start) / iterations;
+
+    dup2(out, STDOUT_FILENO);
+    close(out);
+    close(null);
+    printf("%-16s write + send %8.1f ns/op, writeln (writev) %8.1f ns/op\n", "writeln", separate, vectored);
+}
+
+#define PTYS 64
+#define PTY_ROUNDS 2000
+
+/* Read everything the ptys have to offer, so writes to them don't block for long. Returns the bytes read. */
+static size_t pty_drain(const int* masters)
+{
+    char buf[4096];
+    size_t total = 0;
+    for (int i = 0; i < PTYS; ++i) {
+        ssize_t n;
+        while ((n = read(masters[i], buf, sizeof buf)) > 0) {
+            total += (size_t)n;
+        }
+    }
+    return total;
+}
+
+static double pty_run(const int* masters, const int* slaves, bool uring)
+{
+    char chunk[256];
+    memset(chunk, 'x', sizeof chunk);
+    size_t received = 0;
+    double start = now_ns();
+    for (int round = 0; round < PTY_ROUNDS; ++round) {
+        for (int i = 0; i < PTYS; ++i) {
+            tty_dwrite(slaves[i], chunk, sizeof chunk);
+        }
+        if (uring)
+            tty_uring_submit();
+        received += pty_drain(masters);
+    }
+    // until everything arrived, io_uring writes can still be in flight
+    while (received < sizeof chunk * PTY_ROUNDS * PTYS) {
+        if (uring)
+            tty_uring_submit();
+        received += pty_drain(masters);
+    }
+    if (uring)
+        tty_uring_wait();
+    return (now_ns() - start) / ((double)PTY_ROUNDS * PTYS);
+}
+
+/* Writes to many ptys, like a multiplexer, with a write() per fd against batched io_uring submissions */
+static void pty_bench(void)
+{
+    int masters[PTYS];
+    int slaves[PTYS];
+    for (int i = 0; i < PTYS; ++i) {
+        masters[i] = posix_openpt(O_RDWR | O_NOCTTY);
+        if (masters[i] == -1 || grantpt(masters[i]) || unlockpt(masters[i])) {
+            printf("%-16s no ptys: %s\n", "pty", strerror(errno));
+            return;
+        }
+        fcntl(masters[i], F_SETFL, fcntl(masters[i], F_GETFL) | O_NONBLOCK);
+        slaves[i] = open(ptsname(masters[i]), O_RDWR | O_NOCTTY);
+        struct termios tios;
+        tcgetattr(slaves[i], &tios);
+        tios.c_oflag &= (tcflag_t)~OPOST;
+        tcsetattr(slaves[i], TCSANOW, &tios);
+    }
+
+    double syscalls = pty_run(masters, slaves, false);
+    if (tty_uring_enable(0)) {
+        printf("%-16s %d ptys, write %8.1f ns/op, io_uring unavailable\n", "pty", PTYS, syscalls);
+    }
+    else {
+        double uring = pty_run(masters, slaves, true);
+        tty_uring_disable();
+        printf("%-16s %d ptys, write %8.1f ns/op, io_uring %8.1f ns/op\n", "pty", PTYS, syscalls, uring);
+    }
+
+    for (int i = 0; i < PTYS; ++i) {
+        close(slaves[i]);
+        close(masters[i]);
+    }
+}
+
+int main(void)
+{
+    tty_init_caps();
+
+    // xterm's cup, hpa and vpa start with \E[%i, they are the moves that most need the native encoder
+    const char* term = getenv("TERM");
+    if (term && !strncmp(term, "xterm", 5) && tcaps.cursor_pos.prog &&
+        tparm_get_encoder(tcaps.cursor_pos.prog) != TPARM_ENC_SIMPLE) {
+        printf("cursor_pos isn't using the native encoder\n");
+        return 1;
+    }
+
+    tparm_bench("cursor_pos", &tcaps.cursor_pos);
+    tparm_bench("col_address", &tcaps.col_address);
+    tparm_bench("row_address", &tcaps.row_address);
+    tparm_bench("cursor_right_n", &tcaps.cursor_right_n);
+    tparm_bench("color_set", &tcaps.color_set);
+    tparm_bench("color_bg_set", &tcaps.color_bg_set);
+
+    rgb_bench("rgb to 256", 256);
+    rgb_bench("rgb to 16", 16);
+
+    screen_bench();
+    writeln_bench();
+    pty_bench();
+
+    tty_deinit_caps();
+    return 0;
+}
@@ -19,18 +19,17 @@ void bg_colors_test(void)
 int main()
 {
     tty_init(TTY_NONCANONICAL_MODE);
+    tty_buffer_enable(0);
     Coordinates size = tty_get_size();
 
     int curr_color = 16;
     for (size_t y = 0; y < size.y; ++y) {
-        for (size_t x = 0; x < size.x; ++x) {
-            tty_color_bg_set(curr_color);
-            tty_putc(' ');
-        }
+        tty_fill_rect(0, y, size.x, 1, ' ', (tty_style){.fg = TTY_COLOR_DEFAULT, .bg = curr_color});
         ++curr_color;
     }
     tty_color_reset();
     tty_send(&tcaps.newline);
+    tty_flush();
 
     tty_deinit();
 }
@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <limits.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "../ttyio.h"
@@ -13,35 +14,119 @@ void prompt()
     tty_write(PROMPT, sizeof(PROMPT) - 1);
 }
 
+#define INPUT_MAX 256
+char line[INPUT_MAX];
+size_t len;
+size_t pos;
+
+/* Mid-line edits open or close a cell with insert_character/delete_character, so the rest of the line doesn't have to
+ * be redrawn. Without them, the rest of the line is redrawn and the cursor moved back.
+ */
+void redraw_tail(size_t erase)
+{
+    tty_write(&line[pos], len - pos);
+    for (size_t i = 0; i < erase; ++i) {
+        tty_putc(' ');
+    }
+    tty_send_n(&tcaps.cursor_left, len - pos + erase);
+}
+
+void insert(char c)
+{
+    if (len == INPUT_MAX)
+        return;
+
+    memmove(&line[pos + 1], &line[pos], len - pos);
+    line[pos] = c;
+    ++len;
+    bool mid = pos + 1 < len;
+    bool opened = mid && tty_insert_chars(1) != -1;
+    tty_putc(c);
+    ++pos;
+    if (mid && !opened)
+        redraw_tail(0);
+}
+
 void bs()
 {
-    tty_send(&tcaps.bs);
+    if (!pos)
+        return;
+
+    --pos;
+    --len;
+    memmove(&line[pos], &line[pos + 1], len - pos);
+    if (pos == len) {
+        tty_send(&tcaps.bs);
+        return;
+    }
+    tty_send(&tcaps.cursor_left);
+    if (tty_delete_chars(1) == -1)
+        redraw_tail(1);
+}
+
+void left()
+{
+    if (!pos)
+        return;
+    --pos;
+    tty_send(&tcaps.cursor_left);
+}
+
+void right()
+{
+    if (pos == len)
+        return;
+    ++pos;
+    tty_send(&tcaps.cursor_right);
+}
+
+/* Arrow keys, the ESC has already been read */
+void escape()
+{
+    char seq[2];
+    if (tty_read(&seq[0], 1) <= 0 || tty_read(&seq[1], 1) <= 0 || (seq[0] != '[' && seq[0] != 'O'))
+        return;
+
+    switch (seq[1]) {
+        case 'C':
+            right();
+            break;
+        case 'D':
+            left();
+            break;
+    }
 }
 
 /* repl: some tests and example usage */
 int main(void)
 {
     tty_init(TTY_NONCANONICAL_MODE);
+    tty_set_flush_policy(TTY_FLUSH_IDLE);
     tty_send(&tcaps.scr_clr);
     tty_send(&tcaps.cursor_home);
 
     char c;
     prompt();
 
-    while (read(STDIN_FILENO, &c, 1) > 0) {
+    while (tty_read(&c, 1) > 0) {
         switch (c) {
             case 127:
                 bs();
                 break;
+            case '\033':
+                escape();
+                break;
             case 'q':
                 goto end;
             case '\r':
             case '\n':
                 tty_send(&tcaps.newline);
                 prompt();
+                len = 0;
+                pos = 0;
                 break;
             default:
-                tty_putc(c);
+                insert(c);
                 break;
         }
     }
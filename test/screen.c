@@ -0,0 +1,68 @@
+#include <poll.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "../ttyio.h"
+#include "../ttyscreen.h"
+
+static size_t x = 2;
+static size_t y = 2;
+
+static void draw(void* data)
+{
+    (void)data;
+    tty_style normal = {.fg = TTY_COLOR_DEFAULT, .bg = TTY_COLOR_DEFAULT};
+    tty_style box = {.fg = TTY_COLOR_DEFAULT, .bg = 4};
+    tty_style status = {.fg = TTY_COLOR_DEFAULT, .bg = TTY_COLOR_DEFAULT, .attrs = TTY_ATTR_REVERSE};
+
+    Coordinates size = tty_screen_size();
+    char buf[64];
+    snprintf(buf, sizeof buf, " box at %zu, %zu ", x, y);
+    tty_screen_clear();
+    tty_screen_print(0, 0, normal, "hjkl to move, q to quit");
+    tty_screen_fill(x, y, 6, 3, " ", 1, box);
+    tty_screen_print(0, size.y ? size.y - 1 : 0, status, buf);
+}
+
+/* screen: moves a box around with hjkl using the screen layer, only the cells that change are written.
+ * Keys only invalidate the screen, holding a key down still presents at most TTYSCREEN_FRAME_RATE times a second.
+ * q to quit.
+ */
+int main(void)
+{
+    tty_init(TTY_NONCANONICAL_MODE);
+    tty_screen_init();
+    tty_set_render_callback(draw, NULL);
+    tty_invalidate();
+
+    int timeout = tty_render();
+    char c = 0;
+    for (;;) {
+        struct pollfd fds[] = {{.fd = STDIN_FILENO, .events = POLLIN}, {.fd = tty_render_fd(), .events = POLLIN}};
+        if (poll(fds, 2, timeout) > 0 && fds[0].revents & POLLIN) {
+            if (tty_read(&c, 1) <= 0 || c == 'q')
+                break;
+            switch (c) {
+                case 'h':
+                    x -= x > 0;
+                    break;
+                case 'j':
+                    ++y;
+                    break;
+                case 'k':
+                    y -= y > 0;
+                    break;
+                case 'l':
+                    ++x;
+                    break;
+            }
+            tty_invalidate();
+        }
+        timeout = tty_render();
+    }
+
+    tty_screen_deinit();
+    tty_color_reset();
+    tty_send(&tcaps.scr_clr);
+    tty_deinit();
+}
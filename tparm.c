@@ -0,0 +1,827 @@
+/* Copyright ttyio (C) by Alex Eski 2025 */
+/* Licensed under GPLv3, see LICENSE for more information. */
+/* tparm.c: compiles terminfo parameterized strings into ops, and runs them */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tparm.h"
+#include "ttyplatform.h" // used for including stdbool in cases its needed
+
+// same limits as unibi_format
+#define TPARM_STACK_MAX 123
+#define TPARM_VARS 52
+#define TPARM_WIDTH_MAX 256
+
+enum tparm_code__ {
+    OP_LIT,     /* output pool[arg..arg+a] */
+    OP_PARAM,   /* push param arg */
+    OP_NUM,     /* push arg */
+    OP_GET,     /* push var arg, 0-25 dynamic and 26-51 static */
+    OP_SET,     /* pop into var arg */
+    OP_INC,     /* %i, add 1 to the first two params */
+    OP_OUT_D,   /* pop and output as %d */
+    OP_PARAM_D, /* output param arg as %d, fused %p1%d used by the native encoder */
+    OP_OUT_C,   /* pop and output as a char */
+    OP_OUT_FMT, /* pop and output with the printf spec at pool[arg], a is width and b is precision, -1 if not set */
+    OP_JZ,      /* pop and jump to op arg if 0 */
+    OP_JMP,     /* jump to op arg */
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_MOD,
+    OP_AND,
+    OP_OR,
+    OP_XOR,
+    OP_EQ,
+    OP_LT,
+    OP_GT,
+    OP_LAND,
+    OP_LOR,
+    OP_NOT,
+    OP_COMPL
+};
+
+typedef struct {
+    unsigned char code;
+    short a;
+    short b;
+    int arg;
+} tparm_op__;
+
+#define TPARM_INT_MAX_LEN (sizeof "-2147483648" - 1)
+
+struct tparm {
+    enum tparm_encoder encoder;
+    size_t max_len; /* native encoders can write without bounds checks when buf is at least this big */
+    size_t nops;
+    bool uses_vars;
+    char fg_bg;     /* TPARM_ENC_ANSI_COLOR, '3' for foreground, '4' for background */
+    char* pool;
+    tparm_op__ ops[];
+};
+
+/* setaf and setab strings that use TPARM_ENC_ANSI_COLOR */
+static const struct {
+    const char* fmt;
+    char fg_bg;
+} tparm_ansi_colors__[] = {
+    {"\033[%?%p1%{8}%<%t3%p1%d%e%p1%{16}%<%t9%p1%{8}%-%d%e38;5;%p1%d%;m", '3'},
+    {"\033[%?%p1%{8}%<%t4%p1%d%e%p1%{16}%<%t10%p1%{8}%-%d%e48;5;%p1%d%;m", '4'},
+};
+
+/* State used while compiling, jump targets are source offsets until every op has been emitted */
+typedef struct {
+    const char* fmt;
+    size_t len;
+    size_t nops;
+    size_t pool_len;
+    bool lit_mergeable;
+    bool uses_vars;
+    tparm_op__* ops;
+    size_t* op_src;    /* source offset of each op */
+    bool* token_start; /* source offsets where a token starts */
+    char* pool;
+} tparm_compiler__;
+
+static void tparm_emit__(tparm_compiler__* restrict c, size_t src, unsigned char code, int arg)
+{
+    c->lit_mergeable = false;
+    c->ops[c->nops] = (tparm_op__){.code = code, .a = -1, .b = -1, .arg = arg};
+    c->op_src[c->nops] = src;
+    ++c->nops;
+}
+
+static void tparm_emit_lit__(tparm_compiler__* restrict c, size_t src, const char* restrict s, size_t n)
+{
+    memcpy(c->pool + c->pool_len, s, n);
+    // literals only separated by padding, or a '$' that wasn't padding, are output as one literal
+    if (c->lit_mergeable && c->nops) {
+        c->ops[c->nops - 1].a += (short)n;
+    }
+    else {
+        tparm_emit__(c, src, OP_LIT, (int)c->pool_len);
+        c->ops[c->nops - 1].a = (short)n;
+        c->lit_mergeable = true;
+    }
+    c->pool_len += n;
+}
+
+/* Where unibi_format continues after a false %t (stop_at_else) or after %e, as a source offset */
+static size_t tparm_skip__(const char* restrict fmt, size_t pos, bool stop_at_else)
+{
+    size_t nesting = 0;
+    for (; fmt[pos]; ++pos) {
+        if (fmt[pos] != '%')
+            continue;
+        ++pos;
+        if (fmt[pos] == '?') {
+            ++nesting;
+        }
+        else if (fmt[pos] == ';') {
+            if (!nesting)
+                return pos + 1;
+            --nesting;
+        }
+        else if (fmt[pos] == 'e' && !nesting && stop_at_else) {
+            return pos + 1;
+        }
+        else if (!fmt[pos]) {
+            break;
+        }
+    }
+    return pos;
+}
+
+static bool tparm_isdigit__(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static int tparm_strtoi__(const char* restrict s, size_t* restrict pos)
+{
+    long r = 0;
+    while (tparm_isdigit__(s[*pos])) {
+        if (r <= TPARM_WIDTH_MAX)
+            r = r * 10 + (s[*pos] - '0');
+        ++*pos;
+    }
+    return (int)r;
+}
+
+/* Padding like $<5/> isn't output by unibi_run, returns the offset after it or 0 if fmt + pos isn't padding */
+static size_t tparm_padding__(const char* restrict fmt, size_t pos)
+{
+    if (fmt[pos] != '<' || !tparm_isdigit__(fmt[pos + 1]))
+        return 0;
+
+    size_t v = pos + 1;
+    tparm_strtoi__(fmt, &v);
+    if (fmt[v] == '.')
+        ++v;
+    if (tparm_isdigit__(fmt[v]))
+        ++v;
+    if (fmt[v] == '/') {
+        ++v;
+        if (fmt[v] == '*')
+            ++v;
+    }
+    else if (fmt[v] == '*') {
+        ++v;
+        if (fmt[v] == '/')
+            ++v;
+    }
+    return fmt[v] == '>' ? v + 1 : 0;
+}
+
+/* %[:][flags][width][.precision][doxX], returns false if unsupported.
+ * Anything that isn't a valid conversion is output as is, same as unibi_format.
+ */
+static bool tparm_compile_printf__(tparm_compiler__* restrict c, size_t* restrict pos)
+{
+    const char* fmt = c->fmt;
+    size_t start = *pos - 1;
+    size_t v = *pos;
+    char spec[sizeof "%# +-0*.*d"];
+    char flags[sizeof "# +-0"];
+    size_t nflags = 0;
+    bool alt = false, spc = false, sgn = false, lft = false, zro = false;
+
+    if (fmt[v] == ':')
+        ++v;
+    for (;; ++v) {
+        if (fmt[v] == '#')
+            alt = true;
+        else if (fmt[v] == ' ')
+            spc = true;
+        else if (fmt[v] == '0')
+            zro = true;
+        else if (fmt[v] == '+')
+            sgn = true;
+        else if (fmt[v] == '-')
+            lft = true;
+        else
+            break;
+    }
+
+    int width = -1, prec = -1;
+    if (tparm_isdigit__(fmt[v]))
+        width = tparm_strtoi__(fmt, &v);
+    if (fmt[v] == '.' && tparm_isdigit__(fmt[v + 1])) {
+        ++v;
+        prec = tparm_strtoi__(fmt, &v);
+    }
+
+    if (!fmt[v] || !strchr("doxXs", fmt[v])) {
+        tparm_emit_lit__(c, start, fmt + start, 2);
+        *pos += 1;
+        return true;
+    }
+    if (fmt[v] == 's' || width > TPARM_WIDTH_MAX || prec > TPARM_WIDTH_MAX)
+        return false;
+
+    if (fmt[v] == 'd' && !alt && !spc && !sgn && !lft && !zro && width == -1 && prec == -1) {
+        tparm_emit__(c, start, OP_OUT_D, 0);
+        *pos = v + 1;
+        return true;
+    }
+
+    // same order of flags unibi_format generates
+    if (alt)
+        flags[nflags++] = '#';
+    if (spc)
+        flags[nflags++] = ' ';
+    if (sgn)
+        flags[nflags++] = '+';
+    if (lft)
+        flags[nflags++] = '-';
+    if (zro)
+        flags[nflags++] = '0';
+    flags[nflags] = '\0';
+    int len = snprintf(spec, sizeof spec, "%%%s%s%s%c", flags, width != -1 ? "*" : "", prec != -1 ? ".*" : "", fmt[v]);
+    assert(len > 0 && (size_t)len < sizeof spec);
+
+    tparm_emit__(c, start, OP_OUT_FMT, (int)c->pool_len);
+    c->ops[c->nops - 1].a = (short)width;
+    c->ops[c->nops - 1].b = (short)prec;
+    memcpy(c->pool + c->pool_len, spec, (size_t)len + 1);
+    c->pool_len += (size_t)len + 1;
+    *pos = v + 1;
+    return true;
+}
+
+static unsigned char tparm_arith_code__(char c)
+{
+    switch (c) {
+    case '+':
+        return OP_ADD;
+    case '-':
+        return OP_SUB;
+    case '*':
+        return OP_MUL;
+    case '/':
+        return OP_DIV;
+    case 'm':
+        return OP_MOD;
+    case '&':
+        return OP_AND;
+    case '|':
+        return OP_OR;
+    case '^':
+        return OP_XOR;
+    case '=':
+        return OP_EQ;
+    case '<':
+        return OP_LT;
+    case '>':
+        return OP_GT;
+    case 'A':
+        return OP_LAND;
+    case 'O':
+        return OP_LOR;
+    case '!':
+        return OP_NOT;
+    case '~':
+        return OP_COMPL;
+    default:
+        return OP_LIT;
+    }
+}
+
+/* Compile one % directive, pos is the offset after the '%'. Returns false if unsupported. */
+static bool tparm_compile_directive__(tparm_compiler__* restrict c, size_t* restrict pos)
+{
+    const char* fmt = c->fmt;
+    size_t start = *pos - 1;
+
+    if (tparm_isdigit__(fmt[*pos]) || (fmt[*pos] && strchr(":# .doxX", fmt[*pos])))
+        return tparm_compile_printf__(c, pos);
+
+    char d = fmt[*pos];
+    if (!d) {
+        tparm_emit_lit__(c, start, "%", 1);
+        return true;
+    }
+
+    char next = fmt[++*pos];
+    switch (d) {
+    case '%':
+        tparm_emit_lit__(c, start, "%", 1);
+        break;
+    case 'c':
+        tparm_emit__(c, start, OP_OUT_C, 0);
+        break;
+    case 's':
+    case 'l':
+        return false;
+    case 'p':
+        if (next >= '1' && next <= '9') {
+            tparm_emit__(c, start, OP_PARAM, next - '1');
+            ++*pos;
+        }
+        else {
+            tparm_emit_lit__(c, start, fmt + start, 2);
+        }
+        break;
+    case 'P':
+    case 'g':
+        if ((next >= 'a' && next <= 'z') || (next >= 'A' && next <= 'Z')) {
+            int var = next >= 'a' ? next - 'a' : 26 + next - 'A';
+            tparm_emit__(c, start, d == 'P' ? OP_SET : OP_GET, var);
+            c->uses_vars = true;
+            ++*pos;
+        }
+        else {
+            tparm_emit_lit__(c, start, fmt + start, 2);
+        }
+        break;
+    case '\'':
+        if (next && fmt[*pos + 1] == '\'') {
+            tparm_emit__(c, start, OP_NUM, (unsigned char)next);
+            *pos += 2;
+        }
+        else {
+            tparm_emit_lit__(c, start, fmt + start, 2);
+        }
+        break;
+    case '{': {
+        size_t r = strspn(fmt + *pos, "0123456789");
+        if (r && fmt[*pos + r] == '}') {
+            tparm_emit__(c, start, OP_NUM, atoi(fmt + *pos));
+            *pos += r + 1;
+        }
+        else {
+            tparm_emit_lit__(c, start, fmt + start, 2);
+        }
+        break;
+    }
+    case 'i':
+        tparm_emit__(c, start, OP_INC, 0);
+        break;
+    case '?':
+    case ';':
+        // no op, but literals can't be merged across them since a jump can land here
+        c->lit_mergeable = false;
+        break;
+    case 't':
+        tparm_emit__(c, start, OP_JZ, (int)tparm_skip__(fmt, *pos, true));
+        break;
+    case 'e':
+        tparm_emit__(c, start, OP_JMP, (int)tparm_skip__(fmt, *pos, false));
+        break;
+    default: {
+        unsigned char code = tparm_arith_code__(d);
+        if (code == OP_LIT)
+            tparm_emit_lit__(c, start, fmt + start, 2);
+        else
+            tparm_emit__(c, start, code, 0);
+        break;
+    }
+    }
+    return true;
+}
+
+/* Jump targets are source offsets, turn them into the index of the first op at or after that offset */
+static bool tparm_resolve_jumps__(tparm_compiler__* restrict c)
+{
+    for (size_t i = 0; i < c->nops; ++i) {
+        tparm_op__* op = &c->ops[i];
+        if (op->code != OP_JZ && op->code != OP_JMP)
+            continue;
+
+        size_t target = (size_t)op->arg;
+        // unibi_format would start parsing from the middle of a token, not worth supporting
+        if (target < c->len && !c->token_start[target])
+            return false;
+
+        size_t j = i + 1;
+        while (j < c->nops && c->op_src[j] < target) {
+            ++j;
+        }
+        op->arg = (int)j;
+    }
+    return true;
+}
+
+/* Use a native encoder if fmt is one of the well-known strings, or only has literals and decimal params.
+ * Simple strings have %p%d pairs fused, so ops can change.
+ */
+static void tparm_bind_encoder__(tparm_compiler__* restrict c, tparm* restrict prog, const char* restrict fmt)
+{
+    for (size_t i = 0; i < sizeof(tparm_ansi_colors__) / sizeof(tparm_ansi_colors__[0]); ++i) {
+        if (!strcmp(fmt, tparm_ansi_colors__[i].fmt)) {
+            prog->encoder = TPARM_ENC_ANSI_COLOR;
+            prog->fg_bg = tparm_ansi_colors__[i].fg_bg;
+            prog->max_len = sizeof "\033[38;5;m" - 1 + TPARM_INT_MAX_LEN;
+            return;
+        }
+    }
+
+    size_t max_len = 0;
+    bool params = false;
+    for (size_t i = 0; i < c->nops; ++i) {
+        if (c->ops[i].code == OP_LIT)
+            max_len += (size_t)c->ops[i].a;
+        // %i is allowed, like after the \E[ of cup, but only before any param is used
+        else if (c->ops[i].code == OP_INC && !params)
+            continue;
+        else if (c->ops[i].code == OP_PARAM && i + 1 < c->nops && c->ops[i + 1].code == OP_OUT_D && ++i) {
+            max_len += TPARM_INT_MAX_LEN;
+            params = true;
+        }
+        else {
+            return;
+        }
+    }
+
+    size_t nops = 0;
+    for (size_t i = 0; i < c->nops; ++i) {
+        c->ops[nops] = c->ops[i];
+        if (c->ops[i].code == OP_PARAM) {
+            c->ops[nops].code = OP_PARAM_D;
+            ++i;
+        }
+        ++nops;
+    }
+    c->nops = nops;
+    prog->encoder = TPARM_ENC_SIMPLE;
+    prog->max_len = max_len;
+}
+
+tparm* tparm_compile(const char* restrict fmt)
+{
+    if (!fmt)
+        return NULL;
+
+    // every op and literal byte comes from at least one byte of fmt, printf specs from at least two
+    size_t len = strlen(fmt);
+    tparm_compiler__ c = {
+        .fmt = fmt,
+        .len = len,
+        .ops = malloc(sizeof(tparm_op__) * (len + 1)),
+        .op_src = malloc(sizeof(size_t) * (len + 1)),
+        .token_start = calloc(len + 1, sizeof(bool)),
+        .pool = malloc(len * sizeof "%# +-0*.*d" / 2 + 1),
+    };
+    tparm* prog = NULL;
+    if (!c.ops || !c.op_src || !c.token_start || !c.pool)
+        goto out;
+
+    size_t pos = 0;
+    while (fmt[pos]) {
+        c.token_start[pos] = true;
+        size_t r = strcspn(fmt + pos, "%$");
+        if (r) {
+            tparm_emit_lit__(&c, pos, fmt + pos, r);
+            pos += r;
+            continue;
+        }
+
+        if (fmt[pos] == '$') {
+            size_t after = tparm_padding__(fmt, pos + 1);
+            if (after) {
+                pos = after;
+            }
+            else {
+                tparm_emit_lit__(&c, pos, "$", 1);
+                ++pos;
+            }
+            continue;
+        }
+
+        ++pos;
+        if (!tparm_compile_directive__(&c, &pos))
+            goto out;
+    }
+
+    if (!tparm_resolve_jumps__(&c))
+        goto out;
+
+    prog = malloc(sizeof(tparm) + sizeof(tparm_op__) * c.nops + c.pool_len);
+    if (!prog)
+        goto out;
+    prog->encoder = TPARM_ENC_OPS;
+    prog->max_len = 0;
+    prog->fg_bg = 0;
+    tparm_bind_encoder__(&c, prog, fmt);
+    prog->nops = c.nops;
+    prog->uses_vars = c.uses_vars;
+    prog->pool = (char*)(prog->ops + c.nops);
+    memcpy(prog->ops, c.ops, sizeof(tparm_op__) * c.nops);
+    memcpy(prog->pool, c.pool, c.pool_len);
+
+out:
+    free(c.ops);
+    free(c.op_src);
+    free(c.token_start);
+    free(c.pool);
+    return prog;
+}
+
+void tparm_free(tparm* prog)
+{
+    free(prog);
+}
+
+enum tparm_encoder tparm_get_encoder(const tparm* prog)
+{
+    return prog->encoder;
+}
+
+static inline void tparm_out__(char* restrict buf, size_t n, size_t* restrict w, const char* restrict s, size_t len)
+{
+    if (*w < n) {
+        size_t k = n - *w < len ? n - *w : len;
+        memcpy(buf + *w, s, k);
+    }
+    *w += len;
+}
+
+/* Integer to decimal, written backwards from the end of tmp. Returns the start. */
+static inline char* tparm_itoa__(int x, char* restrict end)
+{
+    unsigned int u = x < 0 ? 0u - (unsigned int)x : (unsigned int)x;
+    char* p = end;
+    do {
+        *--p = (char)('0' + u % 10);
+        u /= 10;
+    } while (u);
+    if (x < 0)
+        *--p = '-';
+    return p;
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+static size_t tparm_printf__(const tparm_op__* restrict op, const char* restrict spec, int x, char* restrict tmp,
+                             size_t n)
+{
+    int len;
+    if (op->a != -1 && op->b != -1)
+        len = snprintf(tmp, n, spec, op->a, op->b, x);
+    else if (op->a != -1)
+        len = snprintf(tmp, n, spec, op->a, x);
+    else if (op->b != -1)
+        len = snprintf(tmp, n, spec, op->b, x);
+    else
+        len = snprintf(tmp, n, spec, x);
+    return len > 0 ? (size_t)len : 0;
+}
+#pragma GCC diagnostic pop
+
+/* Write x as decimal to out, returns the end. out needs TPARM_INT_MAX_LEN bytes. */
+static inline char* tparm_put_int__(char* restrict out, int x)
+{
+    unsigned int u = (unsigned int)x;
+    if (x < 0) {
+        *out++ = '-';
+        u = 0u - u;
+    }
+
+    if (u < 10) {
+        *out++ = (char)('0' + u);
+        return out;
+    }
+    if (u < 100) {
+        out[0] = (char)('0' + u / 10);
+        out[1] = (char)('0' + u % 10);
+        return out + 2;
+    }
+    if (u < 1000) {
+        out[0] = (char)('0' + u / 100);
+        out[1] = (char)('0' + u / 10 % 10);
+        out[2] = (char)('0' + u % 10);
+        return out + 3;
+    }
+
+    char tmp[TPARM_INT_MAX_LEN];
+    char* start = tmp + sizeof tmp;
+    do {
+        *--start = (char)('0' + u % 10);
+        u /= 10;
+    } while (u);
+    size_t len = (size_t)(tmp + sizeof tmp - start);
+    memcpy(out, start, len);
+    return out + len;
+}
+
+static size_t tparm_run_ops__(const tparm* restrict prog, const int* restrict params, size_t nparams,
+                              char* restrict buf, size_t n);
+
+/* Native encoder for TPARM_ENC_SIMPLE, buf must be at least prog->max_len */
+static size_t tparm_run_simple__(const tparm* restrict prog, const int* restrict params, size_t nparams,
+                                 char* restrict buf)
+{
+    int p[TPARM_PARAMS_MAX] = {0};
+    memcpy(p, params, sizeof(int) * (nparams < TPARM_PARAMS_MAX ? nparams : TPARM_PARAMS_MAX));
+
+    char* out = buf;
+    const tparm_op__* op = prog->ops;
+    const tparm_op__* end = prog->ops + prog->nops;
+    for (; op < end; ++op) {
+        switch (op->code) {
+        case OP_LIT:
+            memcpy(out, prog->pool + op->arg, (size_t)op->a);
+            out += op->a;
+            break;
+        case OP_PARAM_D:
+            out = tparm_put_int__(out, p[op->arg]);
+            break;
+        case OP_INC:
+            ++p[0];
+            ++p[1];
+            break;
+        default:
+            unreachable();
+        }
+    }
+    return (size_t)(out - buf);
+}
+
+/* Native encoder for TPARM_ENC_ANSI_COLOR, buf must be at least prog->max_len */
+static size_t tparm_run_ansi_color__(const tparm* restrict prog, int color, char* restrict buf)
+{
+    char* out = buf;
+    *out++ = '\033';
+    *out++ = '[';
+    if (color < 8) {
+        *out++ = prog->fg_bg;
+        out = tparm_put_int__(out, color);
+    }
+    else if (color < 16) {
+        if (prog->fg_bg == '3') {
+            *out++ = '9';
+        }
+        else {
+            *out++ = '1';
+            *out++ = '0';
+        }
+        out = tparm_put_int__(out, color - 8);
+    }
+    else {
+        *out++ = prog->fg_bg == '3' ? '3' : '4';
+        memcpy(out, "8;5;", 4);
+        out = tparm_put_int__(out + 4, color);
+    }
+    *out++ = 'm';
+    return (size_t)(out - buf);
+}
+
+size_t tparm_run(const tparm* restrict prog, const int* restrict params, size_t nparams, char* restrict buf,
+                 size_t n)
+{
+    if (n >= prog->max_len) {
+        switch (prog->encoder) {
+        case TPARM_ENC_SIMPLE:
+            return tparm_run_simple__(prog, params, nparams, buf);
+        case TPARM_ENC_ANSI_COLOR:
+            return tparm_run_ansi_color__(prog, nparams ? params[0] : 0, buf);
+        case TPARM_ENC_OPS:
+            break;
+        }
+    }
+    return tparm_run_ops__(prog, params, nparams, buf, n);
+}
+
+static size_t tparm_run_ops__(const tparm* restrict prog, const int* restrict params, size_t nparams,
+                              char* restrict buf, size_t n)
+{
+    int p[TPARM_PARAMS_MAX] = {0};
+    int stack[TPARM_STACK_MAX];
+    int vars[TPARM_VARS];
+    size_t sp = 0;
+    size_t w = 0;
+
+    memcpy(p, params, sizeof(int) * (nparams < TPARM_PARAMS_MAX ? nparams : TPARM_PARAMS_MAX));
+    if (prog->uses_vars)
+        memset(vars, 0, sizeof vars);
+
+#define POP() (sp ? stack[--sp] : 0)
+#define PUSH(X)                                                                                                        \
+    do {                                                                                                               \
+        int v_ = (X);                                                                                                  \
+        if (sp < TPARM_STACK_MAX)                                                                                      \
+            stack[sp++] = v_;                                                                                          \
+    } while (0)
+#define ARITH2(O)                                                                                                      \
+    do {                                                                                                               \
+        int y_ = POP();                                                                                                \
+        int x_ = POP();                                                                                                \
+        PUSH(x_ O y_);                                                                                                 \
+    } while (0)
+
+    const tparm_op__* ops = prog->ops;
+    size_t i = 0;
+    while (i < prog->nops) {
+        const tparm_op__* op = &ops[i++];
+        switch (op->code) {
+        case OP_LIT:
+            tparm_out__(buf, n, &w, prog->pool + op->arg, (size_t)op->a);
+            break;
+        case OP_PARAM:
+            PUSH(p[op->arg]);
+            break;
+        case OP_NUM:
+            PUSH(op->arg);
+            break;
+        case OP_GET:
+            PUSH(vars[op->arg]);
+            break;
+        case OP_SET:
+            vars[op->arg] = POP();
+            break;
+        case OP_INC:
+            ++p[0];
+            ++p[1];
+            break;
+        case OP_OUT_D: {
+            char tmp[16];
+            char* start = tparm_itoa__(POP(), tmp + sizeof tmp);
+            tparm_out__(buf, n, &w, start, (size_t)(tmp + sizeof tmp - start));
+            break;
+        }
+        case OP_PARAM_D: {
+            char tmp[16];
+            char* start = tparm_itoa__(p[op->arg], tmp + sizeof tmp);
+            tparm_out__(buf, n, &w, start, (size_t)(tmp + sizeof tmp - start));
+            break;
+        }
+        case OP_OUT_C: {
+            char ch = (char)(unsigned char)POP();
+            tparm_out__(buf, n, &w, &ch, 1);
+            break;
+        }
+        case OP_OUT_FMT: {
+            char tmp[TPARM_WIDTH_MAX * 2 + 16];
+            size_t len = tparm_printf__(op, prog->pool + op->arg, POP(), tmp, sizeof tmp);
+            tparm_out__(buf, n, &w, tmp, len);
+            break;
+        }
+        case OP_JZ:
+            if (!POP())
+                i = (size_t)op->arg;
+            break;
+        case OP_JMP:
+            i = (size_t)op->arg;
+            break;
+        case OP_ADD:
+            ARITH2(+);
+            break;
+        case OP_SUB:
+            ARITH2(-);
+            break;
+        case OP_MUL:
+            ARITH2(*);
+            break;
+        case OP_DIV:
+        case OP_MOD: {
+            int y = POP();
+            int x = POP();
+            // unibi_format doesn't guard against this, but a bad terminfo shouldn't crash
+            PUSH(y ? (op->code == OP_DIV ? x / y : x % y) : 0);
+            break;
+        }
+        case OP_AND:
+            ARITH2(&);
+            break;
+        case OP_OR:
+            ARITH2(|);
+            break;
+        case OP_XOR:
+            ARITH2(^);
+            break;
+        case OP_EQ:
+            ARITH2(==);
+            break;
+        case OP_LT:
+            ARITH2(<);
+            break;
+        case OP_GT:
+            ARITH2(>);
+            break;
+        case OP_LAND:
+            ARITH2(&&);
+            break;
+        case OP_LOR:
+            ARITH2(||);
+            break;
+        case OP_NOT:
+            PUSH(!POP());
+            break;
+        case OP_COMPL:
+            PUSH(~POP());
+            break;
+        default:
+            unreachable();
+        }
+    }
+
+#undef ARITH2
+#undef PUSH
+#undef POP
+
+    return w;
+}
@@ -0,0 +1,46 @@
+/* Copyright ttyio (C) by Alex Eski 2025 */
+/* Licensed under GPLv3, see LICENSE for more information. */
+/* tparm.h: compiles terminfo parameterized strings into ops, so they don't have to be parsed on every use */
+
+#ifndef TPARM_GUARD_H_
+#define TPARM_GUARD_H_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+#define TPARM_PARAMS_MAX 9
+
+/* A compiled terminfo string, created by tparm_compile and freed with tparm_free. */
+typedef struct tparm tparm;
+
+/* How a compiled string is expanded.
+ * Strings with a well-known shape get a native encoder, everything else is run by the op interpreter.
+ */
+enum tparm_encoder {
+    TPARM_ENC_OPS,        /* op interpreter */
+    TPARM_ENC_SIMPLE,     /* only literals and decimal params, like \E[%i%p1%d;%p2%dH */
+    TPARM_ENC_ANSI_COLOR, /* the 8/16/256 color setaf/setab of xterm and most builtin terminals */
+};
+
+/* Compile fmt. Returns NULL if fmt uses something that isn't supported (string params, %s and %l),
+ * then fmt has to be expanded with unibi_run instead.
+ */
+tparm* tparm_compile(const char* restrict fmt);
+void tparm_free(tparm* prog);
+/* The encoder prog was bound to */
+enum tparm_encoder tparm_get_encoder(const tparm* prog);
+
+/* Expand prog with params into buf, writing at most n bytes. Missing params are 0.
+ * Returns the length of the full expansion, like unibi_run, which can be more than n if buf is too small.
+ */
+size_t tparm_run(const tparm* restrict prog, const int* restrict params, size_t nparams, char* restrict buf,
+                 size_t n);
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif // !TPARM_GUARD_H_
@@ -6,10 +6,17 @@
 #define _POSIX_C_SOURCE 200809L
 #endif /* ifndef _POXIC_C_SOURCE */
 
+// the io_uring backend needs syscall() and mmap flags outside of POSIX
+#if defined(TTYIO_IO_URING) && defined(__linux__) && !defined(_DEFAULT_SOURCE)
+#define _DEFAULT_SOURCE
+#endif /* if defined(TTYIO_IO_URING) && defined(__linux__) && !defined(_DEFAULT_SOURCE) */
+
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
 #include <stdarg.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -18,6 +25,7 @@
 #include "lib/unibilium.h"
 #include "terminfo.h"
 #include "tcaps.h"
+#include "tparm.h"
 #include "ttyio.h"
 #include "ttyplatform.h" // used for macros
 
@@ -28,10 +36,115 @@ termcaps tcaps;
 
 static enum input_type tty_input_mode__;
 
+/* Output buffer used by every flush policy other than TTY_FLUSH_IMMEDIATE, see tty_set_flush_policy */
+typedef struct {
+    enum tty_flush_policy policy;
+    size_t len;
+    size_t cap;
+    size_t high_water;
+    size_t frames; /* depth of tty_begin_frame calls, nothing is flushed until the outermost frame ends */
+    enum tty_flush_policy frame_policy; /* policy before the frame started */
+    size_t frame_start;                 /* len before the frame's sync begin sequence */
+    size_t frame_body;                  /* len after it, if nothing was added the frame is empty */
+    bool frame_flushed;                 /* flushed during the frame, like by a query */
+    char* buf;
+} tty_outbuf__;
+
+static tty_outbuf__ tty_out__;
+
+/* Stream written to with stdio that hasn't been flushed yet.
+ * Flushed before raw writes to the same fd, so output stays ordered without flushing on every call.
+ */
+static FILE* tty_stdio_dirty__;
+
+#define tty_buffering__() (tty_out__.policy != TTY_FLUSH_IMMEDIATE)
+
+/* Where ttyio thinks the cursor is, 0 based. Updated by everything ttyio writes to stdout. */
+typedef struct {
+    bool valid;        /* position is known, set by absolute movement or by querying the terminal */
+    bool wrap_pending; /* wrote to the last column on a terminal with eat_newline_glitch, wraps on next char */
+    bool saved_valid;
+    size_t x;
+    size_t y;
+    size_t saved_x;
+    size_t saved_y;
+} tty_cursorpos__;
+
+/* Parser state for escape sequences in text, which can be split across writes */
+typedef struct {
+    enum { ESC_NONE, ESC_START, ESC_CSI, ESC_STR, ESC_STR_END } state;
+    bool intermediate; /* CSI or ESC had intermediate bytes, like ESC ( B or CSI 2 $ x, which don't move the cursor */
+    bool private;      /* CSI had a private marker like ? */
+    int nparams;
+    int params[2];
+} tty_escstate__;
+
+/* Graphic rendition ttyio last set on the terminal, so sequences that wouldn't change anything can be skipped */
+#define TTY_COLOR_UNKNOWN__ -2
+
+typedef struct {
+    int fg; /* TTY_COLOR_UNKNOWN__ until set, or after SGR sequences in text that aren't a reset */
+    int bg;
+    unsigned attrs;
+    bool attrs_known;
+} tty_sgrstate__;
+
+#define TTY_SGR_RESET__                                                                                                \
+    (tty_sgrstate__)                                                                                                   \
+    {                                                                                                                  \
+        .fg = TTY_COLOR_DEFAULT, .bg = TTY_COLOR_DEFAULT, .attrs = TTY_ATTR_NONE, .attrs_known = true                  \
+    }
+#define TTY_SGR_UNKNOWN__                                                                                              \
+    (tty_sgrstate__)                                                                                                   \
+    {                                                                                                                  \
+        .fg = TTY_COLOR_UNKNOWN__, .bg = TTY_COLOR_UNKNOWN__                                                           \
+    }
+
+static tty_sgrstate__ tty_sgr__ = {.fg = TTY_COLOR_UNKNOWN__, .bg = TTY_COLOR_UNKNOWN__};
+
+static tty_cursorpos__ tty_cursor__;
+static tty_escstate__ tty_esc__;
+static Coordinates tty_size__;
+static bool tty_onlcr__ = true;      /* tty driver turns \n into \r\n */
+static bool tty_stderr_shared__ = true; /* stderr goes to the terminal too, so writing to it moves the cursor */
+
+#define TTY_INPUT_QUEUE_SIZE 1024
+
+/* User input read while waiting for query replies, returned by tty_read before reading stdin again */
+typedef struct {
+    size_t len;
+    size_t pos;
+    char buf[TTY_INPUT_QUEUE_SIZE];
+} tty_inqueue__;
+
+static tty_inqueue__ tty_in__;
+static int tty_query_timeout__ = TTYIO_QUERY_TIMEOUT;
+/* DEC rectangular area operations, like DECFRA: -1 until a DA1 reply says, see tty_detect_rect_ops */
+static int tty_rect_ops__ = -1;
+/* Synchronized output: -1 until known from the Sync cap or a DECRQM query the first time a frame begins */
+static int tty_sync__ = -1;
+/* stdout was made non-blocking by tty_set_nonblocking, flushes leave what the terminal didn't take in the buffer */
+static bool tty_nonblocking__;
+/* The original stdout while tty_set_nonblocking has its terminal reopened in its place, -1 otherwise */
+static int tty_blocking_stdout__ = -1;
+
 // For unix like systems
 #if !defined(_WIN32) && !defined(_WIN64)
 
+#   include <fcntl.h>
+#   include <poll.h>
+#   include <signal.h>
 #   include <sys/ioctl.h>
+#   include <sys/uio.h>
+#   if defined(TTYIO_IO_URING) && defined(__linux__) && defined(__has_include)
+#       if __has_include(<linux/io_uring.h>)
+#           include <linux/io_uring.h>
+#           include <sys/mman.h>
+#           include <sys/syscall.h>
+#           define TTY_URING__ 1
+#       endif /* if __has_include(<linux/io_uring.h>) */
+#   endif /* if defined(TTYIO_IO_URING) && defined(__linux__) && defined(__has_include) */
+#   include <time.h>
 
 #   include <termios.h>
 
@@ -84,320 +197,1941 @@ void fatal__(const char* restrict fmt, ...)
 
 #pragma GCC diagnostic pop
 
-Coordinates tty_get_size(void)
+// Size of the terminal, cached and only reloaded after the terminal is resized.
+static unsigned long tty_size_gen__;
+static tty_resize_callback tty_resize_cb__;
+static void* tty_resize_data__;
+
+#if !defined(_WIN32) && !defined(_WIN64)
+static volatile sig_atomic_t tty_winch__;
+static bool tty_winch_installed__;
+static struct sigaction tty_winch_old__;
+#endif /* if !defined(_WIN32) && !defined(_WIN64) */
+
+/* Update the cached size. A change bumps the generation and calls the resize callback. */
+static void tty_size_set__(Coordinates size)
+{
+    if (size.x == tty_size__.x && size.y == tty_size__.y)
+        return;
+
+    bool first = !tty_size__.x;
+    tty_size__ = size;
+    ++tty_size_gen__;
+    // the terminal may have reflowed lines, so the cursor could be anywhere
+    tty_pos_invalidate();
+    if (tty_resize_cb__ && !first)
+        tty_resize_cb__(size, tty_resize_data__);
+}
+
+/* Load the size from the terminal. Falls back to terminfo, then 80x24, when stdout isn't a terminal. */
+static void tty_size_load__(void)
 {
 #if !defined(_WIN32) && !defined(_WIN64)
     struct winsize window;
-    ioctl(STDOUT_FILENO, TIOCGWINSZ, &window);
-    assert(window.ws_col > 0);
-    assert(window.ws_row > 0);
-    return (Coordinates){.x = window.ws_col, .y = window.ws_row};
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &window) == 0 && window.ws_col && window.ws_row) {
+        tty_size_set__((Coordinates){.x = window.ws_col, .y = window.ws_row});
+        return;
+    }
 #else
     HANDLE hStdout = GetStdHandle(STD_OUTPUT_HANDLE);
-    if (hStdout == INVALID_HANDLE_VALUE) {
-        perror("Error loading stdout handle");
-        fatal__("\nCould not get screen info to determine size.\n");
-    }
-
     CONSOLE_SCREEN_BUFFER_INFO csbi;
-    if (!GetConsoleScreenBufferInfo(hStdout, &csbi)) {
-        fatal__("\nCould not get screen info to determine size.\n");
+    if (hStdout != INVALID_HANDLE_VALUE && GetConsoleScreenBufferInfo(hStdout, &csbi)) {
+        int col = csbi.srWindow.Right - csbi.srWindow.Left + 1;
+        int row = csbi.srWindow.Bottom - csbi.srWindow.Top + 1;
+        if (col > 0 && row > 0) {
+            tty_size_set__((Coordinates){.x = (size_t)col, .y = (size_t)row});
+            return;
+        }
     }
+#endif /* if !defined(_WIN32) && !defined(_WIN64) */
 
-    int col = csbi.srWindow.Right - csbi.srWindow.Left + 1;
-    int row = csbi.srWindow.Bottom - csbi.srWindow.Top + 1;
+    int cols = uterm ? unibi_get_num(uterm, unibi_columns) : -1;
+    int lines = uterm ? unibi_get_num(uterm, unibi_lines) : -1;
+    tty_size_set__((Coordinates){.x = cols > 0 ? (size_t)cols : 80, .y = lines > 0 ? (size_t)lines : 24});
+}
+
+#if !defined(_WIN32) && !defined(_WIN64)
+static void tty_winch_handler__(int sig)
+{
+    tty_winch__ = 1;
+    // chain to the handler that was installed before ttyio's
+    if (!(tty_winch_old__.sa_flags & SA_SIGINFO) && tty_winch_old__.sa_handler != SIG_DFL &&
+        tty_winch_old__.sa_handler != SIG_IGN)
+        tty_winch_old__.sa_handler(sig);
+}
 
-    assert(col > 0);
-    assert(row > 0);
+static void tty_winch_install__(void)
+{
+    if (tty_winch_installed__)
+        return;
 
-    return (Coordinates){.x = (size_t)col, .y = (size_t)row};
-#endif
+    struct sigaction sa = {0};
+    sa.sa_handler = tty_winch_handler__;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    tty_winch_installed__ = sigaction(SIGWINCH, &sa, &tty_winch_old__) == 0;
 }
 
-inline Coordinates tty_get_pos(void);
-Coordinates tty_get_pos(void)
+static void tty_winch_uninstall__(void)
 {
-    // NOTE: unibilium doesnt have a way to query the cursor position.
-    // Need to query the terminal for the position on start,
-    // so ttyio's tracking is accurate.
-    // response format from terminal is "/033[{row};{col}R"
-    if (write(STDOUT_FILENO, "\033[6n", 4) == -1)
-        return (Coordinates){0};
+    if (!tty_winch_installed__)
+        return;
 
-    char buf[TTY_BUF_SIZE];
-    int i = 0;
-    while (i < (int)sizeof(buf) - 1) {
-        if (read(STDIN_FILENO, &buf[i], 1) != 1)
-            break;
-        if (buf[i] == 'R')
-            break;
-        i++;
-    }
-    buf[i] = '\0';
+    sigaction(SIGWINCH, &tty_winch_old__, NULL);
+    tty_winch_installed__ = false;
+}
+#endif /* if !defined(_WIN32) && !defined(_WIN64) */
 
-    if (buf[0] != '\033' || buf[1] != '[')
-        return (Coordinates){0};
+/* Reload the size if the terminal was resized since it was last loaded */
+static void tty_size_check__(void)
+{
+#if !defined(_WIN32) && !defined(_WIN64)
+    if (tty_winch_installed__ && !tty_winch__ && tty_size__.x)
+        return;
+    tty_winch__ = 0;
+#endif /* if !defined(_WIN32) && !defined(_WIN64) */
+    // without SIGWINCH, like on windows or before ttyio is initialized, the size is loaded every time
+    tty_size_load__();
+}
 
+Coordinates tty_get_size(void)
+{
+    tty_size_check__();
+    return tty_size__;
+}
 
-    int row, col;
-    if (sscanf(buf + 2, "%d;%d", &row, &col) != 2)
-        return (Coordinates){0};
+unsigned long tty_get_size_generation(void)
+{
+    tty_size_check__();
+    return tty_size_gen__;
+}
 
-    return (Coordinates){.x = col > 0 ? (size_t)col : 0, .y = row > 0 ? (size_t)row - 1 : 0};
+void tty_set_resize_callback(tty_resize_callback callback, void* data)
+{
+    tty_resize_cb__ = callback;
+    tty_resize_data__ = data;
 }
 
-void tty_init_caps(void)
+static inline size_t tty_clamp__(size_t v, size_t max)
 {
-    char* term_name = getenv("TERM");
-    if (term_name) {
-        uterm = unibi_from_term(term_name);
-    }
+    return v < max || !max ? v : max - 1;
+}
 
-    if (!uterm) {
-        char* term_type;
-        uterm = terminfo_from_builtin(term_name, &term_type);
-        free(term_type);
-    }
+/* Move the cursor down a line, the terminal scrolls instead of moving past the last line */
+static inline void tty_cursor_down__(size_t n)
+{
+    tty_cursor__.y = tty_clamp__(tty_cursor__.y + n, tty_size__.y);
+}
 
-    if (!uterm) {
-        fatal__("\nCan't find TERM from environment variables. Specify a terminal type with `setenv TERM <yourtype>'.\n");
-    }
+static inline void tty_cursor_up__(size_t n)
+{
+    tty_cursor__.y = tty_cursor__.y > n ? tty_cursor__.y - n : 0;
+}
 
-    tcaps_init();
+static inline void tty_cursor_goto__(size_t x, size_t y)
+{
+    tty_cursor__.x = tty_clamp__(x, tty_size__.x);
+    tty_cursor__.y = tty_clamp__(y, tty_size__.y);
+    tty_cursor__.valid = true;
 }
 
-void tty_init_input_mode(enum input_type input_type)
+static void tty_cursor_save__(void)
 {
-    tty_input_mode__ = input_type;
-    if (input_type == TTY_CANONICAL_MODE) {
-        return;
-    }
+    tty_cursor__.saved_x = tty_cursor__.x;
+    tty_cursor__.saved_y = tty_cursor__.y;
+    tty_cursor__.saved_valid = tty_cursor__.valid;
+}
 
-#if !defined(_WIN32) && !defined(_WIN64)
-    if (!isatty(STDIN_FILENO)) {
-        tty_fprint(stderr, "Not running in a terminal.\n");
-        exit(EXIT_FAILURE);
-    }
+static void tty_cursor_restore__(void)
+{
+    tty_cursor__.x = tty_cursor__.saved_x;
+    tty_cursor__.y = tty_cursor__.saved_y;
+    tty_cursor__.valid = tty_cursor__.saved_valid;
+}
 
-    if (tcgetattr(STDIN_FILENO, &otios__) != 0) {
-        perror("Could not get terminal settings");
-        exit(EXIT_FAILURE);
+/* A printable char was written at the cursor */
+static inline void tty_cursor_advance__(void)
+{
+    if (tty_cursor__.wrap_pending) {
+        tty_cursor__.wrap_pending = false;
+        tty_cursor__.x = 0;
+        tty_cursor_down__(1);
     }
-    // TODO: mouse support? investigate
-    // printf("\x1b[?1049h\x1b[0m\x1b[2J\x1b[?1003h\x1b[?1015h\x1b[?1006h\x1b[?25l");
 
-    struct termios tios = otios__;
-    tios.c_iflag &= (tcflag_t) ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
-    tios.c_lflag &= (tcflag_t) ~(ECHO | ICANON | IEXTEN | ISIG);
-    tios.c_iflag |= IUTF8;
-    tios.c_cflag |= CS8;
-    tios.c_cc[VMIN] = 1;
-    tios.c_cc[VTIME] = 0;
+    if (++tty_cursor__.x < tty_size__.x)
+        return;
 
-    if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &tios) != 0) {
-        perror("Could not set terminal settings");
-    }
-#else
-    HANDLE hStdin = GetStdHandle(STD_INPUT_HANDLE);
-    if (hStdin == INVALID_HANDLE_VALUE) {
-        perror("Error loading stdin handle");
-        fatal__("\nCould not get terminal info to set to noncanonical mode.\n");
+    if (!tcaps.auto_right_margin) {
+        tty_cursor__.x = tty_size__.x - 1;
     }
-
-    DWORD mode;
-    if (!GetConsoleMode(hStdin, &mode)) {
-        perror("Error loading console mode");
-        fatal__("\nCould not get terminal info to set to noncanonical mode.\n");
+    else if (tcaps.eat_newline_glitch) {
+        tty_cursor__.x = tty_size__.x - 1;
+        tty_cursor__.wrap_pending = true;
     }
-    omode__ = mode;
-
-    // Disable line input and echo input
-    mode &= (DWORD)~(ENABLE_LINE_INPUT | ENABLE_ECHO_INPUT);
-
-    // mode &= ~(ENABLE_PROCESSED_INPUT);
-
-    if (!SetConsoleMode(hStdin, mode)) {
-        perror("Error setting console mode");
-        fatal__("\nCould not set terminal info to set to noncanonical mode.\n");
+    else {
+        tty_cursor__.x = 0;
+        tty_cursor_down__(1);
     }
-#endif
 }
 
-void tty_init(enum input_type input_type)
+static inline size_t tty_esc_param__(int i, size_t def)
 {
-    tty_init_caps();
-    tty_init_input_mode(input_type);
+    return i < tty_esc__.nparams && tty_esc__.params[i] > 0 ? (size_t)tty_esc__.params[i] : def;
 }
 
-void tty_deinit_caps(void)
+/* Final byte of a CSI sequence in text. Sequences that may move the cursor in unknown ways invalidate it. */
+static void tty_cursor_csi__(char final)
 {
-    fflush(stdout);
-    unibi_destroy(uterm);
-}
+    if (tty_esc__.intermediate)
+        return;
 
-void tty_deinit_input_mode(void)
-{
-    if (tty_input_mode__ == TTY_CANONICAL_MODE) {
+    if (tty_esc__.private) {
+        // private modes and queries don't move the cursor, except a few modes
+        if (final != 'h' && final != 'l')
+            return;
+        switch (tty_esc_param__(0, 0)) {
+        case 3: // column mode, clears the screen
+        case 6: // origin mode, addressing is relative to the scroll region
+            tty_cursor__.valid = false;
+            break;
+        case 1048: // save or restore the cursor
+        case 1049: // same, and switch to or from the alternate screen
+            if (final == 'h')
+                tty_cursor_save__();
+            else
+                tty_cursor_restore__();
+            break;
+        default:
+            break;
+        }
         return;
     }
 
-#if !defined(_WIN32) && !defined(_WIN64)
-    if (tcsetattr(STDIN_FILENO, TCSANOW, &otios__) != 0) {
-        perror("Could not restore terminal settings");
+    size_t n = tty_esc_param__(0, 1);
+    switch (final) {
+    case 'A':
+        tty_cursor_up__(n);
+        break;
+    case 'B':
+    case 'e':
+        tty_cursor_down__(n);
+        break;
+    case 'C':
+    case 'a':
+        tty_cursor__.x = tty_clamp__(tty_cursor__.x + n, tty_size__.x);
+        break;
+    case 'D':
+        tty_cursor__.x = tty_cursor__.x > n ? tty_cursor__.x - n : 0;
+        break;
+    case 'E':
+        tty_cursor_down__(n);
+        tty_cursor__.x = 0;
+        break;
+    case 'F':
+        tty_cursor_up__(n);
+        tty_cursor__.x = 0;
+        break;
+    case 'G':
+    case '`':
+        tty_cursor__.x = tty_clamp__(n - 1, tty_size__.x);
+        break;
+    case 'd':
+        tty_cursor__.y = tty_clamp__(n - 1, tty_size__.y);
+        break;
+    case 'H':
+    case 'f':
+        tty_cursor_goto__(tty_esc_param__(1, 1) - 1, n - 1);
+        break;
+    case 'r':
+        // setting the scroll region homes the cursor
+        tty_cursor_goto__(0, 0);
+        break;
+    case 'L':
+    case 'M':
+        tty_cursor__.x = 0;
+        break;
+    case 'b':
+        // repeat the last char n times, at most a screen's worth since that's enough to know where it ends up
+        for (size_t i = 0; i < n && i < tty_size__.x * tty_size__.y; ++i) {
+            tty_cursor_advance__();
+        }
+        return;
+    case 's':
+        tty_cursor_save__();
+        break;
+    case 'u':
+        tty_cursor_restore__();
+        break;
+    case 'm':
+        // a reset, "\033[m" or "\033[0m", is known, anything else could have changed the colors or attributes
+        if (!tty_esc__.nparams || (tty_esc__.nparams == 1 && !tty_esc__.params[0]))
+            tty_sgr__ = TTY_SGR_RESET__;
+        else
+            tty_sgr__ = TTY_SGR_UNKNOWN__;
+        return;
+    case 'K':
+    case 'J':
+    case 'X':
+    case 'P':
+    case '@':
+    case 'S':
+    case 'T':
+    case 'n':
+    case 'c':
+    case 't':
+    case 'q':
+    case 'g':
+    case 'h':
+    case 'l':
+        return;
+    default:
+        tty_cursor__.valid = false;
+        return;
     }
-#else
-    HANDLE hStdin = GetStdHandle(STD_INPUT_HANDLE);
-    SetConsoleMode(hStdin, omode__);
-#endif /* if !defined(_WIN32) && !defined(_WIN64) */
+    tty_cursor__.wrap_pending = false;
 }
 
-void tty_deinit(void)
+/* Final byte of an ESC sequence in text */
+static void tty_cursor_esc__(char final)
 {
-    tty_deinit_caps();
-    tty_deinit_input_mode();
+    if (tty_esc__.intermediate)
+        return;
+
+    switch (final) {
+    case '7':
+        tty_cursor_save__();
+        break;
+    case '8':
+        tty_cursor_restore__();
+        break;
+    case 'E':
+        tty_cursor__.x = 0;
+        tty_cursor_down__(1);
+        break;
+    case 'D':
+        tty_cursor_down__(1);
+        break;
+    case 'M':
+        tty_cursor_up__(1);
+        break;
+    case 'c':
+        tty_cursor_goto__(0, 0);
+        tty_sgr__ = TTY_SGR_RESET__;
+        break;
+    case '=':
+    case '>':
+    case '\\':
+        return;
+    default:
+        tty_cursor__.valid = false;
+        return;
+    }
+    tty_cursor__.wrap_pending = false;
 }
 
-int tty_putc_invis()
+/* Update the cursor for everything written to stdout: printable chars, control chars and escape sequences,
+ * whether they come from text or caps. UTF-8 continuation bytes don't move the cursor, wide chars are counted
+ * as one column. Sequences that move the cursor in ways that aren't tracked invalidate it.
+ */
+static void tty_cursor_text__(const char* restrict buf, size_t n)
 {
-    char c = '\n';
-    _MAYBE_UNUSED_ int printed = write(STDOUT_FILENO, &c, 1);
-    assert(printed != EOF && printed == 1);
-    return 1;
+    for (size_t i = 0; i < n; ++i) {
+        unsigned char c = (unsigned char)buf[i];
+        switch (tty_esc__.state) {
+        case ESC_NONE:
+            break;
+        case ESC_START:
+            if (c >= 0x20 && c <= 0x2f) {
+                tty_esc__.intermediate = true;
+                continue;
+            }
+            if (c == '[') {
+                tty_esc__ = (tty_escstate__){.state = ESC_CSI};
+            }
+            else if (c == ']' || c == 'P' || c == '_' || c == '^' || c == 'X') {
+                tty_esc__.state = ESC_STR;
+            }
+            else {
+                tty_cursor_esc__((char)c);
+                tty_esc__.state = ESC_NONE;
+            }
+            continue;
+        case ESC_CSI:
+            if (c >= '0' && c <= '9') {
+                if (!tty_esc__.nparams)
+                    tty_esc__.nparams = 1;
+                // only the first 2 params are used for cursor movement
+                if (tty_esc__.nparams <= 2 && tty_esc__.params[tty_esc__.nparams - 1] < 100000)
+                    tty_esc__.params[tty_esc__.nparams - 1] = tty_esc__.params[tty_esc__.nparams - 1] * 10 + (c - '0');
+            }
+            else if (c == ';' || c == ':') {
+                tty_esc__.nparams = tty_esc__.nparams ? tty_esc__.nparams + 1 : 2;
+            }
+            else if (c >= 0x3c && c <= 0x3f) {
+                tty_esc__.private = true;
+            }
+            else if (c >= 0x20 && c <= 0x2f) {
+                tty_esc__.intermediate = true;
+            }
+            else if (c >= 0x40 && c <= 0x7e) {
+                tty_cursor_csi__((char)c);
+                tty_esc__.state = ESC_NONE;
+            }
+            continue;
+        case ESC_STR:
+            // OSC, DCS and friends end with BEL or ST
+            if (c == '\a')
+                tty_esc__.state = ESC_NONE;
+            else if (c == '\033')
+                tty_esc__.state = ESC_STR_END;
+            continue;
+        case ESC_STR_END:
+            tty_esc__.state = c == '\\' ? ESC_NONE : ESC_STR;
+            continue;
+        }
+
+        if (c >= 0x20 && c != 0x7f) {
+            if (c < 0x80 || c >= 0xc0)
+                tty_cursor_advance__();
+            continue;
+        }
+
+        switch (c) {
+        case '\033':
+            tty_esc__ = (tty_escstate__){.state = ESC_START};
+            break;
+        case '\r':
+            tty_cursor__.x = 0;
+            tty_cursor__.wrap_pending = false;
+            break;
+        case '\n':
+            if (tty_onlcr__)
+                tty_cursor__.x = 0;
+            tty_cursor_down__(1);
+            tty_cursor__.wrap_pending = false;
+            break;
+        case '\b':
+            if (tty_cursor__.x)
+                --tty_cursor__.x;
+            tty_cursor__.wrap_pending = false;
+            break;
+        case '\t':
+            tty_cursor__.x = tty_clamp__((tty_cursor__.x / 8 + 1) * 8, tty_size__.x);
+            tty_cursor__.wrap_pending = false;
+            break;
+        default:
+            break;
+        }
+    }
 }
 
-int tty_putc(char c)
+void tty_pos_invalidate(void)
 {
-    _MAYBE_UNUSED_ int printed = write(STDOUT_FILENO, &c, 1);
-    assert(printed != EOF && printed == 1);
-    return 1;
+    tty_cursor__.valid = false;
+    tty_cursor__.wrap_pending = false;
 }
 
-int tty_fputc(FILE* restrict file, char c)
+Coordinates tty_get_pos(void)
 {
-    _MAYBE_UNUSED_ int printed = write(fileno(file), &c, 1);
-    assert(printed != EOF && printed == 1);
-    return 1;
+    // x is 1 based and y is 0 based, kept for compatibility
+    if (tty_cursor__.valid)
+        return (Coordinates){.x = tty_cursor__.x + 1, .y = tty_cursor__.y};
+    return tty_sync_pos();
 }
 
-int tty_dputc(int fd, char c)
+Coordinates tty_sync_pos(void)
 {
-    _MAYBE_UNUSED_ int printed = write(fd, &c, 1);
-    assert(printed != EOF && printed == 1);
-    return 1;
+    // NOTE: unibilium doesnt have a way to query the cursor position.
+    // Need to query the terminal for the position on start,
+    // so ttyio's tracking is accurate.
+    tty_query_result result;
+    if (!(tty_query(TTY_QUERY_POS, &result) & TTY_QUERY_POS))
+        return (Coordinates){.x = TTY_POS_UNKNOWN, .y = TTY_POS_UNKNOWN};
+    return result.pos;
 }
 
-int tty_write(const char* restrict buf, size_t n)
+/* Keep input that isn't a reply so tty_read can return it. Input past the size of the queue is dropped. */
+static void tty_in_push__(const char* restrict buf, size_t n)
 {
-    int printed = write(STDOUT_FILENO, buf, n);
-    assert(printed != EOF && (size_t)printed == n);
-    return printed;
+    if (tty_in__.pos) {
+        memmove(tty_in__.buf, tty_in__.buf + tty_in__.pos, tty_in__.len - tty_in__.pos);
+        tty_in__.len -= tty_in__.pos;
+        tty_in__.pos = 0;
+    }
+
+    size_t avail = sizeof(tty_in__.buf) - tty_in__.len;
+    if (n > avail)
+        n = avail;
+    memcpy(tty_in__.buf + tty_in__.len, buf, n);
+    tty_in__.len += n;
 }
 
-int tty_writeln(const char* restrict buf, size_t n)
+#define TTY_REPLY_PARAMS_MAX TTY_QUERY_DA1_MAX
+
+/* Parser for query replies. Bytes that turn out not to be a reply, like keys pressed while waiting, are input. */
+typedef struct {
+    enum { REPLY_GROUND, REPLY_ESC, REPLY_CSI, REPLY_DCS, REPLY_DCS_ESC } state;
+    char private; /* private marker of a CSI, like ? for DA1 replies */
+    char intermediate; /* like $ for DECRQM replies */
+    size_t nparams;
+    int params[TTY_REPLY_PARAMS_MAX];
+    size_t len;
+    char seq[TTY_BUF_SIZE * 2]; /* raw bytes of the sequence being parsed */
+} tty_replyparser__;
+
+/* A CSI sequence ended, returns true if it was the reply to a pending query */
+static bool tty_reply_csi__(tty_replyparser__* restrict p, char final, unsigned* restrict pending,
+                            tty_query_result* restrict result)
 {
-    int printed = write(STDOUT_FILENO, buf, n);
-    assert(printed != EOF && (size_t)printed == n);
-    tty_send(&tcaps.newline);
-    return printed;
+    // "\033[{row};{col}R". A modified F3 key press is "\033[1;{mod}R", a position off the screen is one of those.
+    size_t row = p->nparams == 2 && p->params[0] > 0 ? (size_t)p->params[0] : 1;
+    size_t col = p->nparams == 2 && p->params[1] > 0 ? (size_t)p->params[1] : 1;
+    bool on_screen = !tty_size__.x || (col <= tty_size__.x && row <= tty_size__.y);
+    if (final == 'R' && !p->private && p->nparams == 2 && on_screen && (*pending & TTY_QUERY_POS)) {
+        result->pos = (Coordinates){.x = col, .y = row - 1};
+        tty_cursor_goto__(col - 1, row - 1);
+        tty_cursor__.wrap_pending = false;
+        *pending &= ~(unsigned)TTY_QUERY_POS;
+        result->answered |= TTY_QUERY_POS;
+        return true;
+    }
+
+    if (final == 't' && !p->private && p->nparams == 3 && p->params[0] == 8 && (*pending & TTY_QUERY_SIZE)) {
+        // "\033[8;{rows};{cols}t"
+        if (p->params[1] > 0 && p->params[2] > 0) {
+            result->size = (Coordinates){.x = (size_t)p->params[2], .y = (size_t)p->params[1]};
+            tty_size_set__(result->size);
+            result->answered |= TTY_QUERY_SIZE;
+        }
+        *pending &= ~(unsigned)TTY_QUERY_SIZE;
+        return true;
+    }
+
+    if (final == 'y' && p->private == '?' && p->intermediate == '$' && p->nparams == 2 && p->params[0] == 2026 &&
+        (*pending & TTY_QUERY_SYNC)) {
+        // "\033[?2026;{status}$y"
+        result->sync = p->params[1];
+        *pending &= ~(unsigned)TTY_QUERY_SYNC;
+        result->answered |= TTY_QUERY_SYNC;
+        return true;
+    }
+
+    if (final == 'c' && p->private == '?' && (*pending & TTY_QUERY_DA1)) {
+        // "\033[?{class};{attr};...c"
+        result->da1_len = p->nparams;
+        memcpy(result->da1, p->params, p->nparams * sizeof(p->params[0]));
+        // every query gets a DA1 reply, so support for rectangular editing (28) is known after the first one
+        tty_rect_ops__ = 0;
+        for (size_t i = 0; i < p->nparams; ++i) {
+            if (p->params[i] == 28)
+                tty_rect_ops__ = 1;
+        }
+        *pending &= ~(unsigned)TTY_QUERY_DA1;
+        result->answered |= TTY_QUERY_DA1;
+        return true;
+    }
+
+    return false;
 }
 
-int tty_fwrite(FILE* restrict file, const char* restrict buf, size_t n)
+/* A DCS string ended, returns true if it was the reply to a pending query */
+static bool tty_reply_dcs__(tty_replyparser__* restrict p, unsigned* restrict pending,
+                            tty_query_result* restrict result)
 {
-    int printed = write(fileno(file), buf, n);
-    assert(printed != EOF && (size_t)printed == n);
-    return printed;
+    // "\033P>|{name and version}\033\\"
+    if (!(*pending & TTY_QUERY_VERSION) || p->len < 6 || memcmp(p->seq, "\033P>|", 4))
+        return false;
+
+    size_t len = p->len - 6;
+    if (len >= sizeof(result->version))
+        len = sizeof(result->version) - 1;
+    memcpy(result->version, p->seq + 4, len);
+    result->version[len] = '\0';
+    *pending &= ~(unsigned)TTY_QUERY_VERSION;
+    result->answered |= TTY_QUERY_VERSION;
+    return true;
 }
 
-int tty_fwriteln(FILE* restrict file, const char* restrict buf, size_t n)
+static void tty_reply_parse__(tty_replyparser__* restrict p, char c, unsigned* restrict pending,
+                              tty_query_result* restrict result)
 {
-    int fd = fileno(file);
-    int printed = write(fd, buf, n);
-    assert(printed != EOF && (size_t)printed == n);
-    tty_dsend(fd, &tcaps.newline);
-    return printed;
+    if (p->state == REPLY_GROUND) {
+        if (c != '\033') {
+            tty_in_push__(&c, 1);
+            return;
+        }
+        p->state = REPLY_ESC;
+        p->len = 0;
+    }
+
+    if (p->len == sizeof(p->seq)) {
+        // too long to be a reply
+        tty_in_push__(p->seq, p->len);
+        p->state = REPLY_GROUND;
+        tty_reply_parse__(p, c, pending, result);
+        return;
+    }
+    p->seq[p->len++] = c;
+
+    switch (p->state) {
+    case REPLY_GROUND:
+        unreachable();
+    case REPLY_ESC:
+        if (p->len == 1)
+            return;
+        if (c == '[') {
+            p->state = REPLY_CSI;
+            p->private = 0;
+            p->intermediate = 0;
+            p->nparams = 0;
+            memset(p->params, 0, sizeof(p->params));
+            return;
+        }
+        if (c == 'P') {
+            p->state = REPLY_DCS;
+            return;
+        }
+        if (c == '\033') {
+            // a lone escape key press followed by another sequence
+            tty_in_push__(p->seq, 1);
+            p->len = 1;
+            return;
+        }
+        // alt + key
+        tty_in_push__(p->seq, p->len);
+        p->state = REPLY_GROUND;
+        return;
+    case REPLY_CSI:
+        if (c >= '0' && c <= '9') {
+            if (!p->nparams)
+                p->nparams = 1;
+            int* param = &p->params[p->nparams - 1];
+            if (*param < 100000)
+                *param = *param * 10 + (c - '0');
+            return;
+        }
+        if (c == ';') {
+            if (!p->nparams)
+                p->params[p->nparams++] = 0;
+            if (p->nparams < TTY_REPLY_PARAMS_MAX)
+                p->params[p->nparams++] = 0;
+            return;
+        }
+        if (c >= 0x3c && c <= 0x3f) {
+            p->private = c;
+            return;
+        }
+        if (c >= 0x20 && c <= 0x2f) {
+            p->intermediate = c;
+            return;
+        }
+        if (c >= 0x40 && c <= 0x7e && !tty_reply_csi__(p, c, pending, result))
+            tty_in_push__(p->seq, p->len);
+        if (c >= 0x40 && c <= 0x7e)
+            p->state = REPLY_GROUND;
+        return;
+    case REPLY_DCS:
+        if (c == '\033')
+            p->state = REPLY_DCS_ESC;
+        return;
+    case REPLY_DCS_ESC:
+        if (c != '\\') {
+            p->state = REPLY_DCS;
+            return;
+        }
+        if (!tty_reply_dcs__(p, pending, result))
+            tty_in_push__(p->seq, p->len);
+        p->state = REPLY_GROUND;
+        return;
+    }
 }
 
-int tty_dwrite(int fd, const char* restrict buf, size_t n)
+#if defined(TTY_URING__)
+/* io_uring output backend, see tty_uring_enable. Writes are copied into a queue per fd, and the queues of all fds are
+ * submitted together with one io_uring_enter. Each fd has at most one write in flight, so its output stays in order.
+ */
+typedef struct {
+    char* buf;
+    size_t len;
+    size_t cap;
+} tty_uring_buf__;
+
+typedef struct {
+    tty_uring_buf__ sending; /* being written, doesn't move until the write completes */
+    tty_uring_buf__ queued;  /* written after it */
+    size_t sent;             /* bytes of sending written so far */
+    bool inflight;           /* a write, or a poll for when the fd is writable again, hasn't completed */
+    bool blocked;            /* the last write would have blocked, wait for the fd to be writable first */
+    bool listed;             /* in the ready list */
+    bool known;              /* blocking was checked */
+    bool blocking;           /* fd isn't O_NONBLOCK, checked the first time output is queued for it */
+    int error;               /* errno of the last failed write, reported by tty_uring_wait */
+} tty_uring_fd__;
+
+typedef struct {
+    int fd; /* the ring, -1 when disabled */
+    unsigned sq_entries;
+    unsigned cq_entries;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    void* ring;
+    size_t ring_size;
+    size_t sqes_size;
+    unsigned inflight;  /* submitted, not completed yet */
+    unsigned unsubmitted; /* in the submission queue, not passed to io_uring_enter yet */
+    tty_uring_fd__* fds; /* indexed by fd */
+    size_t nfds;
+    int* ready; /* fds with output that can be submitted */
+    size_t nready;
+    size_t ready_cap;
+} tty_uring__;
+
+static tty_uring__ tty_ring__ = {.fd = -1};
+
+#define TTY_URING_POLL__ ((__u64)1 << 32) /* user_data flag for polls, the fd is in the low bits */
+
+static bool tty_uring_buf_add__(tty_uring_buf__* restrict b, const char* restrict buf, size_t n)
 {
-    int printed = write(fd, buf, n);
-    assert(printed != EOF && (size_t)printed == n);
-    return printed;
+    if (b->len + n > b->cap) {
+        size_t new_cap = b->cap ? b->cap : TTY_BUF_SIZE * 64;
+        while (new_cap < b->len + n) {
+            new_cap *= 2;
+        }
+        char* new_buf = realloc(b->buf, new_cap);
+        if (!new_buf)
+            return false;
+        b->buf = new_buf;
+        b->cap = new_cap;
+    }
+    memcpy(b->buf + b->len, buf, n);
+    b->len += n;
+    return true;
 }
 
-int tty_dwriteln(int fd, const char* restrict buf, size_t n)
+static void tty_uring_list__(int fd)
 {
-    int printed = write(fd, buf, n);
-    assert(printed != EOF && (size_t)printed == n);
-    tty_dsend(fd, &tcaps.newline);
-    return printed;
+    tty_uring_fd__* st = &tty_ring__.fds[fd];
+    if (st->listed)
+        return;
+    if (tty_ring__.nready == tty_ring__.ready_cap) {
+        size_t new_cap = tty_ring__.ready_cap ? tty_ring__.ready_cap * 2 : 64;
+        int* ready = realloc(tty_ring__.ready, new_cap * sizeof(*ready));
+        if (!ready)
+            return;
+        tty_ring__.ready = ready;
+        tty_ring__.ready_cap = new_cap;
+    }
+    tty_ring__.ready[tty_ring__.nready++] = fd;
+    st->listed = true;
 }
 
-int tty_puts(const char* restrict str)
+/* Copy output for fd into its queue. It is written by the next tty_uring_submit. */
+static int tty_uring_queue__(int fd, const char* restrict buf, size_t n)
 {
-    return puts(str);
+    if (fd < 0)
+        return EOF;
+    if ((size_t)fd >= tty_ring__.nfds) {
+        size_t nfds = tty_ring__.nfds ? tty_ring__.nfds : 64;
+        while (nfds <= (size_t)fd) {
+            nfds *= 2;
+        }
+        tty_uring_fd__* fds = realloc(tty_ring__.fds, nfds * sizeof(*fds));
+        if (!fds)
+            return EOF;
+        memset(fds + tty_ring__.nfds, 0, (nfds - tty_ring__.nfds) * sizeof(*fds));
+        tty_ring__.fds = fds;
+        tty_ring__.nfds = nfds;
+    }
+
+    tty_uring_fd__* st = &tty_ring__.fds[fd];
+    if (!st->known) {
+        int flags = fcntl(fd, F_GETFL);
+        st->blocking = flags == -1 || !(flags & O_NONBLOCK);
+        st->known = true;
+    }
+    if (!tty_uring_buf_add__(&st->queued, buf, n))
+        return EOF;
+    tty_uring_list__(fd);
+    return (int)n;
 }
 
-int tty_fputs(const char* restrict str, FILE* restrict file)
+/* Add a write of what is left of fd's sending buffer, or a poll if it would block, to the submission queue */
+static bool tty_uring_prep__(int fd)
 {
-    int printed = fputs(str, file);
-    tty_send(&tcaps.newline);
-    return printed;
+    unsigned tail = *tty_ring__.sq_tail;
+    if (tail - __atomic_load_n(tty_ring__.sq_head, __ATOMIC_ACQUIRE) == tty_ring__.sq_entries)
+        return false;
+
+    tty_uring_fd__* st = &tty_ring__.fds[fd];
+    unsigned idx = tail & *tty_ring__.sq_mask;
+    struct io_uring_sqe* sqe = &tty_ring__.sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->fd = fd;
+    if (st->blocked) {
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->poll32_events = POLLOUT;
+        sqe->user_data = TTY_URING_POLL__ | (__u64)fd;
+    }
+    else {
+        size_t len = st->sending.len - st->sent;
+        sqe->opcode = IORING_OP_WRITE;
+        // a write to a blocking fd would block io_uring_enter, have one of io_uring's workers do it
+        sqe->flags = st->blocking ? IOSQE_ASYNC : 0;
+        sqe->addr = (__u64)(uintptr_t)(st->sending.buf + st->sent);
+        sqe->len = len > INT_MAX ? INT_MAX : (unsigned)len;
+        sqe->off = (__u64)-1;
+        sqe->user_data = (__u64)fd;
+    }
+    tty_ring__.sq_array[idx] = idx;
+    __atomic_store_n(tty_ring__.sq_tail, tail + 1, __ATOMIC_RELEASE);
+    st->inflight = true;
+    ++tty_ring__.inflight;
+    ++tty_ring__.unsubmitted;
+    return true;
 }
 
-int tty_print(const char* restrict fmt, ...)
+/* Handle completed writes and polls, fds with more to write go back on the ready list */
+static void tty_uring_reap__(void)
 {
-    int printed;
-    va_list args;
-    va_start(args, fmt);
-    printed = vfprintf(stdout, fmt, args);
-    va_end(args);
-    fflush(stdout);
-    return printed;
+    unsigned head = *tty_ring__.cq_head;
+    unsigned tail = __atomic_load_n(tty_ring__.cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+        struct io_uring_cqe* cqe = &tty_ring__.cqes[head & *tty_ring__.cq_mask];
+        int fd = (int)(cqe->user_data & 0xffffffff);
+        tty_uring_fd__* st = &tty_ring__.fds[fd];
+        st->inflight = false;
+        --tty_ring__.inflight;
+
+        if (cqe->user_data & TTY_URING_POLL__)
+            st->blocked = false;
+        else if (cqe->res == -EAGAIN)
+            st->blocked = true;
+        else if (cqe->res > 0)
+            st->sent += (size_t)cqe->res;
+        else if (cqe->res != -EINTR && cqe->res != -ECANCELED) {
+            // dropped, like a failed write(). Writing nothing fails too, retrying it would never finish.
+            st->error = cqe->res ? -cqe->res : EIO;
+            st->sent = st->sending.len;
+        }
+
+        if (st->sent == st->sending.len)
+            st->sending.len = st->sent = 0;
+        if (st->sending.len || st->queued.len)
+            tty_uring_list__(fd);
+    }
+    __atomic_store_n(tty_ring__.cq_head, head, __ATOMIC_RELEASE);
 }
 
-int tty_println(const char* restrict fmt, ...)
+static int tty_uring_enter__(unsigned min_complete)
 {
-    int printed;
-    va_list args;
-    va_start(args, fmt);
-    printed = vfprintf(stdout, fmt, args);
-    va_end(args);
-    fflush(stdout);
-    tty_send(&tcaps.newline);
-    return printed;
+    int rc = (int)syscall(__NR_io_uring_enter, tty_ring__.fd, tty_ring__.unsubmitted, min_complete,
+                          min_complete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    if (rc < 0)
+        return errno == EINTR || errno == EAGAIN || errno == EBUSY ? 0 : -1;
+    tty_ring__.unsubmitted -= (unsigned)rc;
+    return 0;
 }
 
-int tty_fprint(FILE* restrict file, const char* restrict fmt, ...)
+/* Report a failed write since the last call, with errno set to its error */
+static int tty_uring_error__(void)
 {
-    int printed;
-    va_list args;
-    va_start(args, fmt);
-    printed = vfprintf(file, fmt, args);
-    va_end(args);
-    fflush(stdout);
-    return printed;
+    int rc = 0;
+    for (size_t i = 0; i < tty_ring__.nfds; ++i) {
+        if (tty_ring__.fds[i].error) {
+            errno = tty_ring__.fds[i].error;
+            tty_ring__.fds[i].error = 0;
+            rc = -1;
+        }
+    }
+    return rc;
 }
 
-int tty_fprintln(FILE* restrict file, const char* restrict fmt, ...)
+/* Like tty_uring_submit, leaving failed writes to be reported by the next tty_uring_submit, wait or tty_flush */
+static int tty_uring_send__(void)
 {
-    int printed;
-    va_list args;
-    va_start(args, fmt);
-    printed = vfprintf(file, fmt, args);
-    va_end(args);
-    fflush(stdout);
-    tty_fsend(&tcaps.newline, file);
-    return printed;
+    if (tty_ring__.fd == -1)
+        return 0;
+
+    tty_uring_reap__();
+    size_t kept = 0;
+    for (size_t i = 0; i < tty_ring__.nready; ++i) {
+        int fd = tty_ring__.ready[i];
+        tty_uring_fd__* st = &tty_ring__.fds[fd];
+        if (!st->inflight && !st->sending.len) {
+            tty_uring_buf__ swap = st->sending;
+            st->sending = st->queued;
+            st->queued = swap;
+        }
+        // listed again when the write in flight completes
+        if (st->inflight || !st->sending.len) {
+            st->listed = false;
+            continue;
+        }
+        // every write needs room for its completion, the rest wait for the next submit
+        if (tty_ring__.inflight >= tty_ring__.cq_entries || !tty_uring_prep__(fd)) {
+            tty_ring__.ready[kept++] = fd;
+            continue;
+        }
+        st->listed = false;
+    }
+    tty_ring__.nready = kept;
+    return tty_ring__.unsubmitted ? tty_uring_enter__(0) : 0;
 }
 
-int tty_dprint(int fd, const char* restrict fmt, ...)
+int tty_uring_submit(void)
+{
+    if (tty_ring__.fd == -1)
+        return 0;
+
+    int rc = tty_uring_send__();
+    return tty_uring_error__() ? -1 : rc;
+}
+
+int tty_uring_wait(void)
+{
+    if (tty_ring__.fd == -1)
+        return 0;
+
+    int rc = tty_uring_send__();
+    while (!rc && (tty_ring__.inflight || tty_ring__.nready)) {
+        rc = tty_uring_enter__(1);
+        if (!rc)
+            rc = tty_uring_send__();
+    }
+    return tty_uring_error__() ? -1 : rc;
+}
+
+int tty_uring_enable(unsigned entries)
+{
+    if (tty_ring__.fd != -1)
+        return 0;
+
+    struct io_uring_params params = {0};
+    int fd = (int)syscall(__NR_io_uring_setup, entries ? entries : TTYIO_URING_ENTRIES, &params);
+    if (fd < 0)
+        return -1;
+    // one mapping for both rings, on kernels older than 5.4 use write()
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+        close(fd);
+        return -1;
+    }
+
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    size_t ring_size = sq_size > cq_size ? sq_size : cq_size;
+    size_t sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    char* ring = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ring == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    void* sqes = mmap(NULL, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        munmap(ring, ring_size);
+        close(fd);
+        return -1;
+    }
+
+    tty_flush();
+    tty_ring__ = (tty_uring__){
+        .fd = fd,
+        .sq_entries = params.sq_entries,
+        .cq_entries = params.cq_entries,
+        .sq_head = (unsigned*)(void*)(ring + params.sq_off.head),
+        .sq_tail = (unsigned*)(void*)(ring + params.sq_off.tail),
+        .sq_mask = (unsigned*)(void*)(ring + params.sq_off.ring_mask),
+        .sq_array = (unsigned*)(void*)(ring + params.sq_off.array),
+        .cq_head = (unsigned*)(void*)(ring + params.cq_off.head),
+        .cq_tail = (unsigned*)(void*)(ring + params.cq_off.tail),
+        .cq_mask = (unsigned*)(void*)(ring + params.cq_off.ring_mask),
+        .cqes = (struct io_uring_cqe*)(void*)(ring + params.cq_off.cqes),
+        .sqes = sqes,
+        .ring = ring,
+        .ring_size = ring_size,
+        .sqes_size = sqes_size,
+    };
+    return 0;
+}
+
+void tty_uring_disable(void)
+{
+    if (tty_ring__.fd == -1)
+        return;
+
+    tty_uring_wait();
+    munmap(tty_ring__.sqes, tty_ring__.sqes_size);
+    munmap(tty_ring__.ring, tty_ring__.ring_size);
+    close(tty_ring__.fd);
+    for (size_t i = 0; i < tty_ring__.nfds; ++i) {
+        free(tty_ring__.fds[i].sending.buf);
+        free(tty_ring__.fds[i].queued.buf);
+    }
+    free(tty_ring__.fds);
+    free(tty_ring__.ready);
+    tty_ring__ = (tty_uring__){.fd = -1};
+}
+
+bool tty_uring_enabled(void)
+{
+    return tty_ring__.fd != -1;
+}
+
+/* Bytes queued for fd that weren't written yet */
+static size_t tty_uring_pending__(int fd)
+{
+    if (tty_ring__.fd == -1 || fd < 0 || (size_t)fd >= tty_ring__.nfds)
+        return 0;
+    tty_uring_fd__* st = &tty_ring__.fds[fd];
+    return st->sending.len - st->sent + st->queued.len;
+}
+#else
+int tty_uring_enable(unsigned entries)
+{
+    (void)entries;
+    return -1;
+}
+
+void tty_uring_disable(void)
+{
+}
+
+bool tty_uring_enabled(void)
+{
+    return false;
+}
+
+int tty_uring_submit(void)
+{
+    return 0;
+}
+
+int tty_uring_wait(void)
+{
+    return 0;
+}
+#endif /* if defined(TTY_URING__) */
+
+/* Write all of buf, retrying partial writes and interrupted writes. Stops early if fd is non-blocking and would block.
+ * Returns the number of bytes written, or EOF if nothing could be written because of an error.
+ */
+static int tty_write_all__(int fd, const char* restrict buf, size_t n)
+{
+#if defined(TTY_URING__)
+    if (tty_ring__.fd != -1) {
+        int rc = tty_uring_queue__(fd, buf, n);
+        // unbuffered output to the terminal goes out right away, the rest waits to be submitted together
+        if (fd == STDOUT_FILENO && !tty_buffering__())
+            tty_uring_send__();
+        return rc;
+    }
+#endif /* if defined(TTY_URING__) */
+    size_t done = 0;
+    while (done < n) {
+        int rc = (int)write(fd, buf + done, n - done);
+        if (rc > 0) {
+            done += (size_t)rc;
+            continue;
+        }
+        if (rc == -1 && errno == EINTR)
+            continue;
+        if (rc == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        return done ? (int)done : EOF;
+    }
+    return (int)done;
+}
+
+/* Segments per writev call, longer lists are written in several calls */
+#define TTY_IOV_MAX__ 32
+
+/* Like tty_write_all__, for a list of segments, written with as few writev calls as possible */
+static int tty_writev_all__(int fd, const tty_iovec* restrict iov, size_t n)
+{
+    size_t done = 0;
+#if defined(TTY_URING__)
+    if (tty_ring__.fd != -1) {
+        // copied into one queue, written with one write
+        for (size_t i = 0; i < n; ++i) {
+            if (tty_uring_queue__(fd, iov[i].buf, iov[i].len) == EOF)
+                return done ? (int)done : EOF;
+            done += iov[i].len;
+        }
+        if (fd == STDOUT_FILENO && !tty_buffering__())
+            tty_uring_send__();
+        return (int)done;
+    }
+#endif /* if defined(TTY_URING__) */
+#if !defined(_WIN32) && !defined(_WIN64)
+    size_t i = 0;   /* first segment not written completely */
+    size_t off = 0; /* bytes of it already written */
+    while (i < n) {
+        struct iovec vec[TTY_IOV_MAX__];
+        int cnt = 0;
+        for (size_t j = i; j < n && cnt < TTY_IOV_MAX__; ++j) {
+            size_t skip = j == i ? off : 0;
+            if (iov[j].len > skip)
+                vec[cnt++] = (struct iovec){.iov_base = (void*)(iov[j].buf + skip), .iov_len = iov[j].len - skip};
+        }
+        if (!cnt)
+            break;
+
+        ssize_t rc = writev(fd, vec, cnt);
+        if (rc == -1 && errno == EINTR)
+            continue;
+        if (rc == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (rc <= 0)
+            return done ? (int)done : EOF;
+        done += (size_t)rc;
+        size_t left = (size_t)rc;
+        while (i < n && left >= iov[i].len - off) {
+            left -= iov[i].len - off;
+            off = 0;
+            ++i;
+        }
+        off += left;
+    }
+#else
+    for (size_t i = 0; i < n; ++i) {
+        int rc = tty_write_all__(fd, iov[i].buf, iov[i].len);
+        if (rc == EOF)
+            return done ? (int)done : EOF;
+        done += (size_t)rc;
+        if ((size_t)rc < iov[i].len)
+            break;
+    }
+#endif /* if !defined(_WIN32) && !defined(_WIN64) */
+    return (int)done;
+}
+
+#if !defined(_WIN32) && !defined(_WIN64)
+static long tty_now_ms__(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+#endif /* if !defined(_WIN32) && !defined(_WIN64) */
+
+unsigned tty_query(unsigned queries, tty_query_result* restrict result)
+{
+    *result = (tty_query_result){0};
+
+#if !defined(_WIN32) && !defined(_WIN64)
+    if (!isatty(STDIN_FILENO) || !isatty(STDOUT_FILENO))
+        return 0;
+
+    char req[32];
+    size_t len = 0;
+    if (queries & TTY_QUERY_POS) {
+        memcpy(req + len, "\033[6n", 4);
+        len += 4;
+    }
+    if (queries & TTY_QUERY_SIZE) {
+        memcpy(req + len, "\033[18t", 5);
+        len += 5;
+    }
+    if (queries & TTY_QUERY_VERSION) {
+        memcpy(req + len, "\033[>0q", 5);
+        len += 5;
+    }
+    if (queries & TTY_QUERY_SYNC) {
+        memcpy(req + len, "\033[?2026$p", 9);
+        len += 9;
+    }
+    // every terminal answers DA1, so it goes last and its reply means there are no more replies coming
+    memcpy(req + len, "\033[c", 3);
+    len += 3;
+
+    // replies don't end with a newline, so they can't be read in canonical mode
+    struct termios tios;
+    bool restore = tty_input_mode__ != TTY_NONCANONICAL_MODE && tcgetattr(STDIN_FILENO, &tios) == 0;
+    if (restore) {
+        struct termios raw = tios;
+        raw.c_lflag &= (tcflag_t) ~(ECHO | ICANON);
+        raw.c_cc[VMIN] = 1;
+        raw.c_cc[VTIME] = 0;
+        tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+    }
+
+    // the reply has to come after everything written before the query
+    tty_drain();
+    unsigned pending = queries | TTY_QUERY_DA1;
+    tty_replyparser__ parser = {0};
+    if (tty_write_all__(STDOUT_FILENO, req, len) == (int)len && tty_drain() != 1) {
+        long deadline = tty_now_ms__() + tty_query_timeout__;
+        while (pending & TTY_QUERY_DA1) {
+            long remaining = deadline - tty_now_ms__();
+            if (remaining <= 0)
+                break;
+
+            struct pollfd pfd = {.fd = STDIN_FILENO, .events = POLLIN};
+            int ready = poll(&pfd, 1, (int)remaining);
+            if (ready == -1 && errno == EINTR)
+                continue;
+            if (ready <= 0)
+                break;
+
+            char buf[TTY_BUF_SIZE];
+            ssize_t n = read(STDIN_FILENO, buf, sizeof buf);
+            if (n == -1 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                break;
+            for (ssize_t i = 0; i < n; ++i) {
+                tty_reply_parse__(&parser, buf[i], &pending, result);
+            }
+        }
+    }
+
+    // a partial sequence when the query timed out, like the escape key, is input
+    if (parser.state != REPLY_GROUND)
+        tty_in_push__(parser.seq, parser.len);
+
+    if (restore)
+        tcsetattr(STDIN_FILENO, TCSANOW, &tios);
+#else
+    (void)queries;
+#endif /* if !defined(_WIN32) && !defined(_WIN64) */
+
+    return result->answered;
+}
+
+void tty_set_query_timeout(int timeout_ms)
+{
+    tty_query_timeout__ = timeout_ms > 0 ? timeout_ms : 0;
+}
+
+int tty_get_query_timeout(void)
+{
+    return tty_query_timeout__;
+}
+
+void tty_init_caps(void)
+{
+    char* term_name = getenv("TERM");
+    if (term_name) {
+        uterm = unibi_from_term(term_name);
+    }
+
+    if (!uterm) {
+        char* term_type;
+        uterm = terminfo_from_builtin(term_name, &term_type);
+        free(term_type);
+    }
+
+    if (!uterm) {
+        fatal__("\nCan't find TERM from environment variables. Specify a terminal type with `setenv TERM <yourtype>'.\n");
+    }
+
+    tcaps_init();
+#if !defined(_WIN32) && !defined(_WIN64)
+    tty_winch_install__();
+#endif /* if !defined(_WIN32) && !defined(_WIN64) */
+    tty_size_check__();
+    tty_pos_invalidate();
+    tty_esc__ = (tty_escstate__){0};
+    tty_rect_ops__ = -1;
+    tty_sync__ = tcaps.sync_begin.len ? 1 : -1;
+
+#if !defined(_WIN32) && !defined(_WIN64)
+    struct termios out_tios;
+    if (tcgetattr(STDOUT_FILENO, &out_tios) == 0)
+        tty_onlcr__ = (out_tios.c_oflag & OPOST) && (out_tios.c_oflag & ONLCR);
+    tty_stderr_shared__ = isatty(STDERR_FILENO);
+#endif /* if !defined(_WIN32) && !defined(_WIN64) */
+}
+
+void tty_init_input_mode(enum input_type input_type)
+{
+    tty_input_mode__ = input_type;
+    if (input_type == TTY_CANONICAL_MODE) {
+        return;
+    }
+
+#if !defined(_WIN32) && !defined(_WIN64)
+    if (!isatty(STDIN_FILENO)) {
+        tty_fprint(stderr, "Not running in a terminal.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (tcgetattr(STDIN_FILENO, &otios__) != 0) {
+        perror("Could not get terminal settings");
+        exit(EXIT_FAILURE);
+    }
+    // TODO: mouse support? investigate
+    // printf("\x1b[?1049h\x1b[0m\x1b[2J\x1b[?1003h\x1b[?1015h\x1b[?1006h\x1b[?25l");
+
+    struct termios tios = otios__;
+    tios.c_iflag &= (tcflag_t) ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    tios.c_lflag &= (tcflag_t) ~(ECHO | ICANON | IEXTEN | ISIG);
+    tios.c_iflag |= IUTF8;
+    tios.c_cflag |= CS8;
+    tios.c_cc[VMIN] = 1;
+    tios.c_cc[VTIME] = 0;
+
+    if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &tios) != 0) {
+        perror("Could not set terminal settings");
+    }
+#else
+    HANDLE hStdin = GetStdHandle(STD_INPUT_HANDLE);
+    if (hStdin == INVALID_HANDLE_VALUE) {
+        perror("Error loading stdin handle");
+        fatal__("\nCould not get terminal info to set to noncanonical mode.\n");
+    }
+
+    DWORD mode;
+    if (!GetConsoleMode(hStdin, &mode)) {
+        perror("Error loading console mode");
+        fatal__("\nCould not get terminal info to set to noncanonical mode.\n");
+    }
+    omode__ = mode;
+
+    // Disable line input and echo input
+    mode &= (DWORD)~(ENABLE_LINE_INPUT | ENABLE_ECHO_INPUT);
+
+    // mode &= ~(ENABLE_PROCESSED_INPUT);
+
+    if (!SetConsoleMode(hStdin, mode)) {
+        perror("Error setting console mode");
+        fatal__("\nCould not set terminal info to set to noncanonical mode.\n");
+    }
+#endif
+}
+
+void tty_init(enum input_type input_type)
+{
+    tty_init_caps();
+    tty_init_input_mode(input_type);
+}
+
+void tty_deinit_caps(void)
+{
+    tty_set_nonblocking(false);
+    tty_buffer_disable();
+    tty_uring_disable();
+    fflush(stdout);
+#if !defined(_WIN32) && !defined(_WIN64)
+    tty_winch_uninstall__();
+#endif /* if !defined(_WIN32) && !defined(_WIN64) */
+    tcaps_deinit();
+    unibi_destroy(uterm);
+}
+
+void tty_deinit_input_mode(void)
+{
+    if (tty_input_mode__ == TTY_CANONICAL_MODE) {
+        return;
+    }
+
+#if !defined(_WIN32) && !defined(_WIN64)
+    if (tcsetattr(STDIN_FILENO, TCSANOW, &otios__) != 0) {
+        perror("Could not restore terminal settings");
+    }
+#else
+    HANDLE hStdin = GetStdHandle(STD_INPUT_HANDLE);
+    SetConsoleMode(hStdin, omode__);
+#endif /* if !defined(_WIN32) && !defined(_WIN64) */
+}
+
+void tty_deinit(void)
+{
+    tty_deinit_caps();
+    tty_deinit_input_mode();
+}
+
+static void tty_stdio_sync__(void)
+{
+    if (!tty_stdio_dirty__)
+        return;
+    fflush(tty_stdio_dirty__);
+    tty_stdio_dirty__ = NULL;
+}
+
+/* Called after writing to a stdio stream, flushes it or marks it as dirty depending on the flush policy */
+static void tty_stdio_written__(FILE* restrict file, bool line_end)
+{
+    if (tty_out__.policy == TTY_FLUSH_IMMEDIATE || (tty_out__.policy == TTY_FLUSH_LINE && line_end)) {
+        fflush(file);
+        if (tty_stdio_dirty__ == file)
+            tty_stdio_dirty__ = NULL;
+        return;
+    }
+
+    if (tty_stdio_dirty__ != file)
+        tty_stdio_sync__();
+    tty_stdio_dirty__ = file;
+}
+
+int tty_flush(void)
+{
+    // anything in the dirty stream was written before what is currently in the buffer
+    tty_stdio_sync__();
+    int printed = 0;
+    if (tty_out__.len) {
+        if (tty_out__.frames)
+            tty_out__.frame_flushed = true;
+        printed = tty_write_all__(STDOUT_FILENO, tty_out__.buf, tty_out__.len);
+    }
+    // with the io_uring backend, along with anything queued for other fds, and failed writes of any fd are reported
+    int failed = tty_uring_submit();
+    // nothing was written, it all stays buffered and the next flush tries again
+    if (printed == EOF)
+        return 1;
+    // the rest stays at the front of the buffer, written before anything else on the next flush
+    if (printed) {
+        tty_out__.len -= (size_t)printed;
+        memmove(tty_out__.buf, tty_out__.buf + printed, tty_out__.len);
+    }
+    return failed ? 1 : tty_out__.len ? TTY_PENDING : 0;
+}
+
+int tty_drain(void)
+{
+    int rc = tty_flush();
+#if !defined(_WIN32) && !defined(_WIN64)
+    while (rc == TTY_PENDING) {
+        struct pollfd pfd = {.fd = STDOUT_FILENO, .events = POLLOUT};
+        if (poll(&pfd, 1, -1) == -1 && errno != EINTR)
+            return 1;
+        rc = tty_flush();
+    }
+#endif /* if !defined(_WIN32) && !defined(_WIN64) */
+    if (!rc && tty_uring_wait())
+        rc = 1;
+    return rc;
+}
+
+#if !defined(_WIN32) && !defined(_WIN64)
+/* stdin and stdout of a terminal are usually one open file, setting O_NONBLOCK on it would make reads of stdin fail
+ * with EAGAIN too. Put a non-blocking open of the same terminal in place of stdout instead, keeping the original.
+ */
+static bool tty_stdout_reopen__(void)
+{
+    const char* path = isatty(STDOUT_FILENO) ? ttyname(STDOUT_FILENO) : NULL;
+    if (!path)
+        return false;
+    int fd = open(path, O_WRONLY | O_NOCTTY | O_NONBLOCK);
+    if (fd == -1)
+        return false;
+    tty_blocking_stdout__ = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+    if (tty_blocking_stdout__ == -1 || dup2(fd, STDOUT_FILENO) == -1) {
+        if (tty_blocking_stdout__ != -1)
+            close(tty_blocking_stdout__);
+        tty_blocking_stdout__ = -1;
+        close(fd);
+        return false;
+    }
+    close(fd);
+    return true;
+}
+#endif /* if !defined(_WIN32) && !defined(_WIN64) */
+
+int tty_set_nonblocking(bool nonblocking)
+{
+#if !defined(_WIN32) && !defined(_WIN64)
+    if (nonblocking == tty_nonblocking__)
+        return 0;
+    if (!nonblocking)
+        tty_drain();
+
+    if (nonblocking && tty_stdout_reopen__()) {
+        tty_nonblocking__ = true;
+        return 0;
+    }
+    if (!nonblocking && tty_blocking_stdout__ != -1) {
+        int rc = dup2(tty_blocking_stdout__, STDOUT_FILENO) == -1 ? -1 : 0;
+        close(tty_blocking_stdout__);
+        tty_blocking_stdout__ = -1;
+        tty_nonblocking__ = false;
+        return rc;
+    }
+
+    // not a terminal, or it couldn't be reopened: set it on stdout's open file, which stdin may share
+    int flags = fcntl(STDOUT_FILENO, F_GETFL);
+    if (flags == -1)
+        return -1;
+    flags = nonblocking ? flags | O_NONBLOCK : flags & ~O_NONBLOCK;
+    if (fcntl(STDOUT_FILENO, F_SETFL, flags) == -1)
+        return -1;
+    tty_nonblocking__ = nonblocking;
+    return 0;
+#else
+    return nonblocking ? -1 : 0;
+#endif /* if !defined(_WIN32) && !defined(_WIN64) */
+}
+
+size_t tty_output_pending(void)
+{
+    size_t pending = tty_out__.len;
+#if defined(TTY_URING__)
+    pending += tty_uring_pending__(STDOUT_FILENO);
+#endif /* if defined(TTY_URING__) */
+#if !defined(_WIN32) && !defined(_WIN64) && defined(TIOCOUTQ)
+    int queued;
+    if (ioctl(STDOUT_FILENO, TIOCOUTQ, &queued) == 0 && queued > 0)
+        pending += (size_t)queued;
+#endif /* if !defined(_WIN32) && !defined(_WIN64) && defined(TIOCOUTQ) */
+    return pending;
+}
+
+bool tty_output_ready(void)
+{
+#if !defined(_WIN32) && !defined(_WIN64)
+    struct pollfd pfd = {.fd = STDOUT_FILENO, .events = POLLOUT};
+    return poll(&pfd, 1, 0) != 0;
+#else
+    return true;
+#endif /* if !defined(_WIN32) && !defined(_WIN64) */
+}
+
+void tty_set_flush_policy(enum tty_flush_policy policy)
+{
+    if (policy == TTY_FLUSH_IMMEDIATE) {
+        tty_drain();
+    }
+    else if (!tty_out__.high_water) {
+        tty_out__.high_water = TTYIO_HIGH_WATER;
+    }
+    tty_out__.policy = policy;
+}
+
+enum tty_flush_policy tty_get_flush_policy(void)
+{
+    return tty_out__.policy;
+}
+
+void tty_buffer_enable(size_t high_water)
+{
+    if (!tty_buffering__())
+        tty_out__.policy = TTY_FLUSH_FRAME;
+    tty_out__.high_water = high_water ? high_water : TTYIO_HIGH_WATER;
+}
+
+void tty_buffer_disable(void)
+{
+    tty_drain();
+    free(tty_out__.buf);
+    tty_out__ = (tty_outbuf__){0};
+}
+
+/* Make room for at least n more bytes in the output buffer. Returns false if the buffer can't grow. */
+static bool tty_buffer_reserve__(size_t n)
+{
+    if (tty_out__.len + n <= tty_out__.cap)
+        return true;
+
+    size_t new_cap = tty_out__.cap ? tty_out__.cap : TTY_BUF_SIZE * 64;
+    while (new_cap < tty_out__.len + n) {
+        new_cap *= 2;
+    }
+
+    char* new_buf = realloc(tty_out__.buf, new_cap);
+    if (!new_buf)
+        return false;
+    tty_out__.buf = new_buf;
+    tty_out__.cap = new_cap;
+    return true;
+}
+
+/* Flush if over the high-water mark, or at the end of a line when using TTY_FLUSH_LINE */
+static inline void tty_buffer_check__(bool line_end)
+{
+    if (tty_out__.frames)
+        return;
+    if (tty_out__.len >= tty_out__.high_water || (line_end && tty_out__.policy == TTY_FLUSH_LINE))
+        tty_flush();
+}
+
+/* Append to the output buffer without flushing. Returns false if the buffer can't grow. */
+static bool tty_buffer_queue__(const char* restrict buf, size_t n)
+{
+    if (!tty_buffer_reserve__(n))
+        return false;
+    memcpy(tty_out__.buf + tty_out__.len, buf, n);
+    tty_out__.len += n;
+    return true;
+}
+
+/* Write segments to stdout, total bytes long, in one writev together with anything already buffered, without copying
+ * them. What the terminal doesn't take right now is queued in the output buffer and written first by the next write or
+ * flush, so escape sequences are never cut off.
+ */
+static int tty_stdout_writev__(const tty_iovec* restrict iov, size_t n, size_t total)
+{
+    tty_iovec vec[TTY_IOV_MAX__];
+    size_t head = tty_out__.len;
+    if (head) {
+        if (n >= TTY_IOV_MAX__) {
+            for (size_t i = 0; i < n; ++i) {
+                if (!tty_buffer_queue__(iov[i].buf, iov[i].len))
+                    return EOF;
+            }
+            // queued, even if the flush fails they stay buffered for the next one
+            tty_flush();
+            return (int)total;
+        }
+        vec[0] = (tty_iovec){.buf = tty_out__.buf, .len = head};
+        memcpy(vec + 1, iov, n * sizeof(*iov));
+    }
+
+    int printed = head ? tty_writev_all__(STDOUT_FILENO, vec, n + 1) : tty_writev_all__(STDOUT_FILENO, iov, n);
+    // what was already buffered stays buffered, the segments weren't written or queued
+    if (printed == EOF)
+        return EOF;
+
+    size_t written = (size_t)printed;
+    if (head) {
+        size_t from_head = written < head ? written : head;
+        memmove(tty_out__.buf, tty_out__.buf + from_head, head - from_head);
+        tty_out__.len = head - from_head;
+        written -= from_head;
+    }
+    if (written == total && !tty_out__.len)
+        return (int)total;
+    // queue what wasn't written after what is still buffered
+    for (size_t i = 0; i < n; ++i) {
+        size_t skip = written < iov[i].len ? written : iov[i].len;
+        written -= skip;
+        if (skip < iov[i].len && !tty_buffer_queue__(iov[i].buf + skip, iov[i].len - skip))
+            return EOF;
+    }
+    return (int)total;
+}
+
+static inline int tty_stdout_write__(const char* restrict buf, size_t n)
+{
+    return tty_stdout_writev__(&(tty_iovec){.buf = buf, .len = n}, 1, n);
+}
+
+static int tty_buffer_append__(const char* restrict buf, size_t n)
+{
+    if (!tty_buffer_reserve__(n)) {
+        if (tty_flush() == 1 || tty_out__.len)
+            return EOF;
+        return tty_write_all__(STDOUT_FILENO, buf, n);
+    }
+
+    memcpy(tty_out__.buf + tty_out__.len, buf, n);
+    tty_out__.len += n;
+    tty_buffer_check__(tty_out__.policy == TTY_FLUSH_LINE && memchr(buf, '\n', n));
+    return (int)n;
+}
+
+/* Format into the output buffer. vsnprintf is retried once the buffer has grown if the output didn't fit. */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+static int tty_buffer_vprint__(const char* restrict fmt, va_list args)
+{
+    va_list args_copy;
+    va_copy(args_copy, args);
+    size_t avail = tty_out__.cap - tty_out__.len;
+    int len = vsnprintf(tty_out__.buf ? tty_out__.buf + tty_out__.len : NULL, avail, fmt, args_copy);
+    va_end(args_copy);
+    if (len < 0)
+        return len;
+
+    if ((size_t)len >= avail) {
+        if (!tty_buffer_reserve__((size_t)len + 1)) {
+            tty_flush();
+            tty_pos_invalidate();
+            return vdprintf(STDOUT_FILENO, fmt, args);
+        }
+        len = vsnprintf(tty_out__.buf + tty_out__.len, (size_t)len + 1, fmt, args);
+    }
+
+    char* start = tty_out__.buf + tty_out__.len;
+    tty_out__.len += (size_t)len;
+    tty_cursor_text__(start, (size_t)len);
+    tty_buffer_check__(tty_out__.policy == TTY_FLUSH_LINE && memchr(start, '\n', (size_t)len));
+    return len;
+}
+#pragma GCC diagnostic pop
+
+/* Write to fd, or append to the output buffer if buffering and fd is stdout */
+static int tty_out_write__(int fd, const char* restrict buf, size_t n)
+{
+    if (tty_stdio_dirty__ && fileno(tty_stdio_dirty__) == fd)
+        tty_stdio_sync__();
+
+    if (fd == STDOUT_FILENO)
+        tty_cursor_text__(buf, n);
+    else if (fd == STDERR_FILENO && tty_stderr_shared__)
+        tty_pos_invalidate();
+
+    if (tty_buffering__()) {
+        if (fd == STDOUT_FILENO)
+            return tty_buffer_append__(buf, n);
+        // keep output to other fds, like stderr, ordered with what is pending for stdout
+        tty_flush();
+    }
+    else if (fd == STDOUT_FILENO) {
+        return tty_stdout_write__(buf, n);
+    }
+    return tty_write_all__(fd, buf, n);
+}
+
+/* Write segments to fd, or append them to the output buffer if buffering and fd is stdout.
+ * Unbuffered, or when they would push the buffer past its high-water mark anyway, they go out in one writev.
+ * line_end is set when they end with the newline cap, which isn't always a \n.
+ */
+static int tty_out_writev__(int fd, const tty_iovec* restrict iov, size_t n, bool line_end)
+{
+    if (tty_stdio_dirty__ && fileno(tty_stdio_dirty__) == fd)
+        tty_stdio_sync__();
+
+    size_t total = 0;
+    line_end = line_end && tty_out__.policy == TTY_FLUSH_LINE;
+    for (size_t i = 0; i < n; ++i) {
+        total += iov[i].len;
+        if (fd == STDOUT_FILENO) {
+            tty_cursor_text__(iov[i].buf, iov[i].len);
+            line_end = line_end || (tty_out__.policy == TTY_FLUSH_LINE && memchr(iov[i].buf, '\n', iov[i].len));
+        }
+    }
+    if (fd == STDERR_FILENO && tty_stderr_shared__)
+        tty_pos_invalidate();
+
+    if (tty_buffering__() && fd == STDOUT_FILENO) {
+        if (!tty_out__.frames && (tty_out__.len + total >= tty_out__.high_water || line_end))
+            return tty_stdout_writev__(iov, n, total);
+        size_t queued = 0;
+        for (size_t i = 0; i < n; ++i) {
+            if (!tty_buffer_queue__(iov[i].buf, iov[i].len))
+                return tty_stdout_writev__(iov + i, n - i, total - queued) == EOF ? EOF : (int)total;
+            queued += iov[i].len;
+        }
+        return (int)total;
+    }
+    if (tty_buffering__())
+        tty_flush();
+    else if (fd == STDOUT_FILENO)
+        return tty_stdout_writev__(iov, n, total);
+    return tty_writev_all__(fd, iov, n);
+}
+
+/* Formatted output to fd, or to the output buffer if buffering and fd is stdout */
+static int tty_out_vprint__(int fd, const char* restrict fmt, va_list args)
+{
+    if (tty_stdio_dirty__ && fileno(tty_stdio_dirty__) == fd)
+        tty_stdio_sync__();
+
+    if (tty_buffering__()) {
+        if (fd == STDOUT_FILENO)
+            return tty_buffer_vprint__(fmt, args);
+        tty_flush();
+    }
+
+    if (fd == STDOUT_FILENO) {
+        // format locally so the output can be tracked, most output fits
+        char buf[TTY_BUF_SIZE * 8];
+        va_list args_copy;
+        va_copy(args_copy, args);
+        int len = vsnprintf(buf, sizeof buf, fmt, args_copy);
+        va_end(args_copy);
+        if (len >= 0 && (size_t)len < sizeof buf) {
+            tty_cursor_text__(buf, (size_t)len);
+            return tty_stdout_write__(buf, (size_t)len);
+        }
+        char* big = len > 0 ? malloc((size_t)len + 1) : NULL;
+        if (big) {
+            vsnprintf(big, (size_t)len + 1, fmt, args);
+            tty_cursor_text__(big, (size_t)len);
+            int printed = tty_stdout_write__(big, (size_t)len);
+            free(big);
+            return printed;
+        }
+        tty_pos_invalidate();
+    }
+    else if (fd == STDERR_FILENO && tty_stderr_shared__) {
+        tty_pos_invalidate();
+    }
+    return vdprintf(fd, fmt, args);
+}
+
+/* Formatted output to a stdio stream, which is flushed according to the flush policy */
+static int tty_out_vfprint__(FILE* restrict file, const char* restrict fmt, va_list args)
+{
+    if (file == stdout)
+        return tty_out_vprint__(STDOUT_FILENO, fmt, args);
+
+    tty_flush();
+    if (file == stderr && tty_stderr_shared__)
+        tty_pos_invalidate();
+    int printed = vfprintf(file, fmt, args);
+    tty_stdio_written__(file, strchr(fmt, '\n'));
+    return printed;
+}
+
+int tty_read(char* restrict buf, size_t n)
+{
+    if (tty_in__.pos < tty_in__.len) {
+        size_t queued = tty_in__.len - tty_in__.pos;
+        if (n > queued)
+            n = queued;
+        memcpy(buf, tty_in__.buf + tty_in__.pos, n);
+        tty_in__.pos += n;
+        return (int)n;
+    }
+
+    // don't leave output sitting in the buffer while blocking for input
+    if (tty_out__.policy == TTY_FLUSH_IDLE || tty_out__.policy == TTY_FLUSH_LINE)
+        tty_flush();
+#if defined(TTY_URING__)
+    tty_uring_send__();
+#endif /* if defined(TTY_URING__) */
+    int rc = (int)read(STDIN_FILENO, buf, n);
+#if !defined(_WIN32) && !defined(_WIN64)
+    // stdin usually shares its file status flags with stdout, so it can be non-blocking too, wait for input anyway
+    while (rc == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        // and keep writing output the terminal didn't take yet while waiting
+        struct pollfd pfds[2] = {{.fd = STDIN_FILENO, .events = POLLIN}, {.fd = STDOUT_FILENO, .events = POLLOUT}};
+        nfds_t nfds = tty_out__.len && tty_out__.policy != TTY_FLUSH_FRAME ? 2 : 1;
+        if (poll(pfds, nfds, -1) == -1 && errno != EINTR)
+            break;
+        if (nfds == 2 && pfds[1].revents & POLLOUT)
+            tty_flush();
+        rc = (int)read(STDIN_FILENO, buf, n);
+    }
+#endif /* if !defined(_WIN32) && !defined(_WIN64) */
+    return rc;
+}
+
+int tty_putc_invis(void)
+{
+    char c = '\n';
+    return tty_out_write__(STDOUT_FILENO, &c, 1) == EOF ? EOF : 1;
+}
+
+int tty_putc(char c)
+{
+    return tty_out_write__(STDOUT_FILENO, &c, 1) == EOF ? EOF : 1;
+}
+
+int tty_fputc(FILE* restrict file, char c)
+{
+    return tty_out_write__(fileno(file), &c, 1) == EOF ? EOF : 1;
+}
+
+int tty_dputc(int fd, char c)
+{
+    return tty_out_write__(fd, &c, 1) == EOF ? EOF : 1;
+}
+
+int tty_write(const char* restrict buf, size_t n)
+{
+    return tty_out_write__(STDOUT_FILENO, buf, n);
+}
+
+int tty_writeln(const char* restrict buf, size_t n)
+{
+    return tty_dwriteln(STDOUT_FILENO, buf, n);
+}
+
+int tty_fwrite(FILE* restrict file, const char* restrict buf, size_t n)
+{
+    return tty_out_write__(fileno(file), buf, n);
+}
+
+int tty_fwriteln(FILE* restrict file, const char* restrict buf, size_t n)
+{
+    return tty_dwriteln(fileno(file), buf, n);
+}
+
+int tty_dwrite(int fd, const char* restrict buf, size_t n)
+{
+    return tty_out_write__(fd, buf, n);
+}
+
+int tty_dwriteln(int fd, const char* restrict buf, size_t n)
+{
+    // the text and the newline go out in one write
+    tty_iovec iov[] = {{.buf = buf, .len = n}, {.buf = tcaps.newline.val, .len = tcaps.newline.len}};
+    int printed = tty_out_writev__(fd, iov, 2, true);
+    return printed == EOF || (size_t)printed < n ? printed : (int)n;
+}
+
+int tty_writev(const tty_iovec* restrict iov, size_t n)
+{
+    return tty_out_writev__(STDOUT_FILENO, iov, n, false);
+}
+
+int tty_fwritev(FILE* restrict file, const tty_iovec* restrict iov, size_t n)
+{
+    return tty_out_writev__(fileno(file), iov, n, false);
+}
+
+int tty_dwritev(int fd, const tty_iovec* restrict iov, size_t n)
+{
+    return tty_out_writev__(fd, iov, n, false);
+}
+
+int tty_puts(const char* restrict str)
+{
+    return tty_dwriteln(STDOUT_FILENO, str, strlen(str));
+}
+
+int tty_fputs(const char* restrict str, FILE* restrict file)
+{
+    return tty_dwriteln(fileno(file), str, strlen(str));
+}
+
+int tty_print(const char* restrict fmt, ...)
+{
+    int printed;
+    va_list args;
+    va_start(args, fmt);
+    printed = tty_out_vprint__(STDOUT_FILENO, fmt, args);
+    va_end(args);
+    return printed;
+}
+
+int tty_println(const char* restrict fmt, ...)
+{
+    int printed;
+    va_list args;
+    va_start(args, fmt);
+    printed = tty_out_vprint__(STDOUT_FILENO, fmt, args);
+    va_end(args);
+    tty_send(&tcaps.newline);
+    return printed;
+}
+
+int tty_fprint(FILE* restrict file, const char* restrict fmt, ...)
+{
+    int printed;
+    va_list args;
+    va_start(args, fmt);
+    printed = tty_out_vfprint__(file, fmt, args);
+    va_end(args);
+    return printed;
+}
+
+int tty_fprintln(FILE* restrict file, const char* restrict fmt, ...)
+{
+    int printed;
+    va_list args;
+    va_start(args, fmt);
+    printed = tty_out_vfprint__(file, fmt, args);
+    va_end(args);
+    tty_fsend(&tcaps.newline, file);
+    return printed;
+}
+
+int tty_dprint(int fd, const char* restrict fmt, ...)
 {
     int printed;
     va_list args;
     va_start(args, fmt);
-    printed = vdprintf(fd, fmt, args);
+    printed = tty_out_vprint__(fd, fmt, args);
     va_end(args);
-    fflush(stdout);
     return printed;
 }
 
@@ -406,95 +2140,882 @@ int tty_dprintln(int fd, const char* restrict fmt, ...)
     int printed;
     va_list args;
     va_start(args, fmt);
-    printed = vdprintf(fd, fmt, args);
+    printed = tty_out_vprint__(fd, fmt, args);
     va_end(args);
-    fflush(stdout);
     tty_dsend(fd, &tcaps.newline);
     return printed;
 }
 
 int tty_perror(const char* restrict msg)
 {
-    char* err_str = strerror(errno);
-    tty_color_set(TTYIO_RED_ERROR);
-    int printed = tty_fprint(stderr, "%s: ", msg);
-    tty_color_reset();
-    printed += tty_fprint(stderr, "%s", err_str);
-    tty_fsend(&tcaps.newline, stderr);
-    return printed;
+    const char* err_str = strerror(errno);
+    // color, message, reset and newline go to stderr in one write
+    size_t color_len = 0;
+    const char* color = tcaps.color_max && tcaps.color_reset.len ? tcaps_color_get(TTYIO_RED_ERROR, false, &color_len)
+                                                                 : NULL;
+    bool colored = color && color_len;
+    size_t msg_len = strlen(msg);
+    tty_iovec iov[] = {
+        {.buf = color, .len = colored ? color_len : 0},
+        {.buf = msg, .len = msg_len},
+        {.buf = ": ", .len = 2},
+        {.buf = tcaps.color_reset.val, .len = colored ? tcaps.color_reset.len : 0},
+        {.buf = err_str, .len = strlen(err_str)},
+        {.buf = tcaps.newline.val, .len = tcaps.newline.len},
+    };
+    int printed = tty_out_writev__(STDERR_FILENO, iov, sizeof(iov) / sizeof(*iov), true);
+    if (colored && tty_stderr_shared__)
+        tty_sgr__ = TTY_SGR_RESET__;
+    return printed == EOF ? EOF : (int)(msg_len + 2 + iov[4].len);
 }
 
 int tty_send(cap* restrict c)
 {
-    assert(c && c->len);
-    if (write(STDOUT_FILENO, c->val, c->len) == -1)
-        return 1;
-    fflush(stdout);
-    return 0;
+    return tty_dsend(STDOUT_FILENO, c);
 }
 
 int tty_fsend(cap* restrict c, FILE* restrict file)
 {
-    assert(c && c->len);
-    fwrite(c->val, sizeof(char), c->len, file);
-    fflush(file);
-    return 0;
+    return tty_dsend(fileno(file), c);
 }
 
 int tty_dsend(int fd, cap* restrict c)
 {
     assert(c && c->len);
-    if (write(fd, c->val, c->len) == -1)
+    if (tty_out_write__(fd, c->val, c->len) == -1)
         return 1;
-    fflush(stdout);
+    if (c->type == CAP_NEWLINE && tty_out__.policy == TTY_FLUSH_LINE && fd == STDOUT_FILENO)
+        tty_flush();
     return 0;
 }
 
-void tty_send_n(cap* restrict c, size_t n)
+/* Expand a parameterized cap into buf, which must be TTY_BUF_SIZE bytes. Returns the length of the expansion. */
+static size_t tty_run__(const cap* restrict c, int p1, int p2, char* restrict buf)
 {
-    for (size_t i = 0; i < n; ++i) {
-        tty_send(c);
+    if (c->prog)
+        return tparm_run(c->prog, (int[2]){p1, p2}, 2, buf, TTY_BUF_SIZE);
+    return unibi_run(c->val, (unibi_var_t[9]){[0] = unibi_var_from_num(p1), [1] = unibi_var_from_num(p2)}, buf,
+                     TTY_BUF_SIZE);
+}
+
+/* Same as tty_run__, for caps with up to 9 params */
+static size_t tty_run_params__(const cap* restrict c, const int* restrict params, size_t n, char* restrict buf)
+{
+    if (c->prog)
+        return tparm_run(c->prog, params, n, buf, TTY_BUF_SIZE);
+
+    unibi_var_t vars[9] = {0};
+    for (size_t i = 0; i < n && i < 9; ++i) {
+        vars[i] = unibi_var_from_num(params[i]);
     }
+    return unibi_run(c->val, vars, buf, TTY_BUF_SIZE);
 }
 
-void tty_fsend_n(cap* restrict c, size_t n, FILE* restrict file)
+/* Send the parameterized equivalent of sending c n times, when the terminal supports it and it is shorter.
+ * Returns false if nothing was sent and the cap should be repeated instead.
+ */
+static bool tty_dsend_parm_n__(int fd, const cap* restrict c, size_t n)
 {
-    for (size_t i = 0; i < n; ++i) {
-        tty_fsend(c, file);
+    const cap* parm;
+    switch (c->type) {
+    case CAP_CURSOR_LEFT:
+    case CAP_BS:
+        parm = &tcaps.cursor_left_n;
+        break;
+    case CAP_CURSOR_RIGHT:
+        parm = &tcaps.cursor_right_n;
+        break;
+    case CAP_CURSOR_UP:
+        parm = &tcaps.cursor_up_n;
+        break;
+    case CAP_CURSOR_DOWN:
+        // a \n cud1 scrolls at the bottom, and goes to the first column with ONLCR, \E[nB does neither
+        if (c->len == 1 && c->val[0] == '\n' &&
+            (fd != STDOUT_FILENO || tty_onlcr__ || !tty_cursor__.valid || tty_cursor__.y + n >= tty_size__.y))
+            return false;
+        parm = &tcaps.cursor_down_n;
+        break;
+    case CAP_SCROLL_FORWARD:
+        parm = &tcaps.scroll_forward_n;
+        break;
+    case CAP_SCROLL_REVERSE:
+        parm = &tcaps.scroll_reverse_n;
+        break;
+    case CAP_LINE_DEL_CHAR:
+        parm = &tcaps.line_del_chars;
+        break;
+    case CAP_LINE_INS_CHAR:
+        parm = &tcaps.line_ins_chars;
+        break;
+    case CAP_LINE_INSERT:
+        parm = &tcaps.line_insert_n;
+        break;
+    case CAP_LINE_DELETE:
+        parm = &tcaps.line_delete_n;
+        break;
+    default:
+        return false;
     }
+    if (!parm->len || n > INT_MAX)
+        return false;
+
+    // backspaces stop at the first column, erasing more cells than that would clear ones they never reached
+    size_t moves = n;
+    if (c->type == CAP_BS) {
+        if (!tcaps.line_erase_chars.len || fd != STDOUT_FILENO || !tty_cursor__.valid || tty_cursor__.wrap_pending ||
+            !tty_cursor__.x)
+            return false;
+        moves = n < tty_cursor__.x ? n : tty_cursor__.x;
+    }
+
+    char buf[TTY_BUF_SIZE * 2];
+    size_t len = tty_run__(parm, (int)moves, 0, buf);
+    // backspace erases as it goes, so move left then erase everything that was moved over
+    if (c->type == CAP_BS)
+        len += tty_run__(&tcaps.line_erase_chars, (int)moves, 0, buf + len);
+
+    if (!len || len >= n * c->len)
+        return false;
+    return tty_out_write__(fd, buf, len) != -1;
+}
+
+int tty_send_parm(cap* restrict c, const int* restrict params, size_t n)
+{
+    return tty_dsend_parm(STDOUT_FILENO, c, params, n);
+}
+
+int tty_dsend_parm(int fd, cap* restrict c, const int* restrict params, size_t n)
+{
+    if (!c->len)
+        return -1;
+
+    char buf[TTY_BUF_SIZE];
+    size_t len = tty_run_params__(c, params, n, buf);
+    if (!len || len > sizeof(buf))
+        return -1;
+    return tty_out_write__(fd, buf, len);
+}
+
+void tty_send_n(cap* restrict c, size_t n)
+{
+    tty_dsend_n(STDOUT_FILENO, c, n);
+}
+
+void tty_fsend_n(cap* restrict c, size_t n, FILE* restrict file)
+{
+    tty_dsend_n(fileno(file), c, n);
 }
 
 void tty_dsend_n(int fd, cap* restrict c, size_t n)
 {
+    if (n > 1 && tty_dsend_parm_n__(fd, c, n))
+        return;
+
     for (size_t i = 0; i < n; ++i) {
         tty_dsend(fd, c);
     }
 }
 
-int tty_color_set(int color)
+/* Send single n times or parm with n, whichever is shorter out of the ones the terminal has */
+static int tty_send_single_or_parm__(cap* restrict single, cap* restrict parm, size_t n)
 {
-    if (!tcaps.color_max)
+    if (!n)
+        return 0;
+    if (single->len) {
+        tty_send_n(single, n);
+        return 0;
+    }
+    if (n > INT_MAX)
+        return -1;
+    return tty_send_parm(parm, (int[]){(int)n}, 1);
+}
+
+int tty_insert_lines(size_t n)
+{
+    return tty_send_single_or_parm__(&tcaps.line_insert, &tcaps.line_insert_n, n);
+}
+
+int tty_delete_lines(size_t n)
+{
+    return tty_send_single_or_parm__(&tcaps.line_delete, &tcaps.line_delete_n, n);
+}
+
+int tty_insert_chars(size_t n)
+{
+    return tty_send_single_or_parm__(&tcaps.line_ins_char, &tcaps.line_ins_chars, n);
+}
+
+int tty_delete_chars(size_t n)
+{
+    return tty_send_single_or_parm__(&tcaps.line_del_char, &tcaps.line_del_chars, n);
+}
+
+#define TTY_MOVE_BUF_SIZE (TTY_BUF_SIZE * 4)
+
+/* A candidate sequence for tty_move_to */
+typedef struct {
+    size_t len;
+    char buf[TTY_MOVE_BUF_SIZE];
+} tty_move__;
+
+/* Append c to m. Returns false if the cap isn't supported or doesn't fit. */
+static bool tty_move_cap__(tty_move__* restrict m, const cap* restrict c)
+{
+    if (!c->len || m->len + c->len > sizeof(m->buf))
+        return false;
+    memcpy(m->buf + m->len, c->val, c->len);
+    m->len += c->len;
+    return true;
+}
+
+static bool tty_move_parm__(tty_move__* restrict m, const cap* restrict c, size_t p1, size_t p2)
+{
+    if (!c->len || p1 > INT_MAX || p2 > INT_MAX || m->len + TTY_BUF_SIZE > sizeof(m->buf))
+        return false;
+    size_t len = tty_run__(c, (int)p1, (int)p2, m->buf + m->len);
+    if (!len || len > TTY_BUF_SIZE)
+        return false;
+    m->len += len;
+    return true;
+}
+
+/* Move n cells along one axis with the single step cap repeated, or the parameterized cap if it is shorter */
+static bool tty_move_axis__(tty_move__* restrict m, const cap* restrict one, const cap* restrict parm, size_t n)
+{
+    size_t start = m->len;
+    size_t parm_len = tty_move_parm__(m, parm, n, 0) ? m->len - start : SIZE_MAX;
+    if (!one->len || n > (sizeof(m->buf) - start) / one->len || n * one->len >= parm_len)
+        return parm_len != SIZE_MAX;
+
+    m->len = start;
+    for (size_t i = 0; i < n; ++i) {
+        memcpy(m->buf + m->len, one->val, one->len);
+        m->len += one->len;
+    }
+    return true;
+}
+
+/* Move relative to (x, y). Vertical first, since moving down with \n can also return to column 0. */
+static bool tty_move_relative__(tty_move__* restrict m, size_t x, size_t y, size_t tx, size_t ty)
+{
+    if (ty > y) {
+        size_t start = m->len;
+        if (!tty_move_axis__(m, &tcaps.cursor_down, &tcaps.cursor_down_n, ty - y))
+            return false;
+        if (tty_onlcr__ && memchr(m->buf + start, '\n', m->len - start))
+            x = 0;
+    }
+    else if (ty < y && !tty_move_axis__(m, &tcaps.cursor_up, &tcaps.cursor_up_n, y - ty)) {
+        return false;
+    }
+
+    if (tx > x)
+        return tty_move_axis__(m, &tcaps.cursor_right, &tcaps.cursor_right_n, tx - x);
+    if (tx < x)
+        return tty_move_axis__(m, &tcaps.cursor_left, &tcaps.cursor_left_n, x - tx);
+    return true;
+}
+
+/* Keep the candidate that was just built if it is the shortest so far, and clear the other buffer for the next */
+static inline void tty_move_pick__(tty_move__ moves[static 2], int* restrict best, int* restrict cur, bool ok)
+{
+    if (ok && (*best < 0 || moves[*cur].len < moves[*best].len)) {
+        *best = *cur;
+        *cur = !*cur;
+    }
+    moves[*cur].len = 0;
+}
+
+int tty_move_to(size_t x, size_t y)
+{
+    tty_size_check__();
+    x = tty_clamp__(x, tty_size__.x);
+    y = tty_clamp__(y, tty_size__.y);
+
+    bool known = tty_cursor__.valid;
+    size_t cx = tty_cursor__.x;
+    size_t cy = tty_cursor__.y;
+    if (known && cx == x && cy == y && !tty_cursor__.wrap_pending)
         return 0;
 
-    char buf[TTY_BUF_SIZE] = {0};
-    size_t len = unibi_run(tcaps.color_set.val, (unibi_var_t[9]){[0] = unibi_var_from_num(color)}, buf, TTY_BUF_SIZE);
+    // build each way of getting there and keep the one with the fewest bytes, absolute addressing wins ties
+    tty_move__ moves[2];
+    int best = -1;
+    int cur = 0;
+    moves[cur].len = 0;
+
+    tty_move_pick__(moves, &best, &cur, tty_move_parm__(&moves[cur], &tcaps.cursor_pos, y, x));
+
+    if (known) {
+        bool ok;
+        if (cy == y)
+            ok = tty_move_parm__(&moves[cur], &tcaps.col_address, x, 0);
+        else if (cx == x)
+            ok = tty_move_parm__(&moves[cur], &tcaps.row_address, y, 0);
+        else
+            ok = tty_move_parm__(&moves[cur], &tcaps.row_address, y, 0) &&
+                 tty_move_parm__(&moves[cur], &tcaps.col_address, x, 0);
+        tty_move_pick__(moves, &best, &cur, ok);
+
+        if (cy != y && cx != x) {
+            ok = tty_move_parm__(&moves[cur], &tcaps.row_address, y, 0) &&
+                 tty_move_relative__(&moves[cur], cx, y, x, y);
+            tty_move_pick__(moves, &best, &cur, ok);
+        }
+
+        // a pending wrap makes relative moves from the last column unreliable on some terminals
+        if (!tty_cursor__.wrap_pending)
+            tty_move_pick__(moves, &best, &cur, tty_move_relative__(&moves[cur], cx, cy, x, y));
+
+        ok = tty_move_cap__(&moves[cur], &tcaps.line_goto_bol) && tty_move_relative__(&moves[cur], 0, cy, x, y);
+        tty_move_pick__(moves, &best, &cur, ok);
+    }
+
+    bool ok = tty_move_cap__(&moves[cur], &tcaps.cursor_home) && tty_move_relative__(&moves[cur], 0, 0, x, y);
+    tty_move_pick__(moves, &best, &cur, ok);
 
-    if (write(STDOUT_FILENO, buf, len) == -1)
+    if (best < 0)
         return 1;
-    fflush(stdout);
+    if (tty_out_write__(STDOUT_FILENO, moves[best].buf, moves[best].len) == -1)
+        return 1;
+
+    tty_cursor_goto__(x, y);
+    tty_cursor__.wrap_pending = false;
     return 0;
 }
 
-int tty_color_bg_set(int color)
+#define TTY_SGR_BUF_SIZE (TTY_BUF_SIZE * 4)
+
+/* Sequences for a change in graphic rendition. SGR sequences next to each other are merged into one. */
+typedef struct {
+    size_t len;
+    size_t sgr; /* start of the SGR sequence at the end of buf, SIZE_MAX if buf doesn't end with one */
+    char buf[TTY_SGR_BUF_SIZE];
+} tty_sgrbuf__;
+
+/* Is seq a plain SGR sequence, "\033[" followed by parameters and 'm' */
+static bool tty_sgr_shape__(const char* restrict seq, size_t len)
+{
+    if (len < 3 || seq[0] != '\033' || seq[1] != '[' || seq[len - 1] != 'm')
+        return false;
+    for (size_t i = 2; i < len - 1; ++i) {
+        if ((seq[i] < '0' || seq[i] > '9') && seq[i] != ';' && seq[i] != ':')
+            return false;
+    }
+    return true;
+}
+
+/* Append seq to b. Returns false if it doesn't fit. */
+static bool tty_sgr_add__(tty_sgrbuf__* restrict b, const char* restrict seq, size_t len)
+{
+    if (b->len + len + 2 > sizeof(b->buf))
+        return false;
+
+    if (b->sgr != SIZE_MAX && tty_sgr_shape__(seq, len)) {
+        // "\033[1m" and "\033[31m" become "\033[1;31m", an empty parameter list means 0
+        --b->len;
+        if (b->len - b->sgr == 2)
+            b->buf[b->len++] = '0';
+        b->buf[b->len++] = ';';
+        if (len == 3)
+            b->buf[b->len++] = '0';
+        memcpy(b->buf + b->len, seq + 2, len - 2);
+        b->len += len - 2;
+        return true;
+    }
+
+    memcpy(b->buf + b->len, seq, len);
+    b->len += len;
+
+    // caps like exit_attribute_mode can end with an SGR sequence after something else, like "\033(B\033[m"
+    b->sgr = SIZE_MAX;
+    for (size_t i = len; i-- > 0;) {
+        if (seq[i] == '\033') {
+            if (tty_sgr_shape__(seq + i, len - i))
+                b->sgr = b->len - (len - i);
+            break;
+        }
+    }
+    return true;
+}
+
+#define TTY_COLOR_IS_RGB__(color) ((color) >= 0 && ((color) & 0x1000000))
+
+/* RGB colors are kept as is on terminals with 24-bit color, otherwise they become the nearest palette color */
+static inline int tty_color_resolve__(int color)
+{
+    if (!TTY_COLOR_IS_RGB__(color) || tcaps.color_rgb)
+        return color;
+    int palette = tcaps_color_rgb_to_palette((unsigned char)(color >> 16), (unsigned char)(color >> 8),
+                                             (unsigned char)color);
+    return palette < 0 ? TTY_COLOR_DEFAULT : palette;
+}
+
+/* Append the sequence for a color to b */
+static bool tty_sgr_color__(tty_sgrbuf__* restrict b, int color, bool bg)
+{
+    if (TTY_COLOR_IS_RGB__(color)) {
+        const cap* c = bg ? &tcaps.color_rgb_bg_set : &tcaps.color_rgb_set;
+        if (!c->len)
+            return false;
+        char buf[TTY_BUF_SIZE];
+        int rgb[3] = {(color >> 16) & 0xff, (color >> 8) & 0xff, color & 0xff};
+        size_t len = tty_run_params__(c, rgb, 3, buf);
+        return len && len <= sizeof(buf) && tty_sgr_add__(b, buf, len);
+    }
+
+    size_t len;
+    const char* seq = tcaps_color_get(color, bg, &len);
+    char buf[TTY_BUF_SIZE];
+    if (!seq) {
+        const cap* c = bg ? &tcaps.color_bg_set : &tcaps.color_set;
+        if (!c->len)
+            return false;
+        len = tty_run__(c, color, 0, buf);
+        seq = buf;
+    }
+    return tty_sgr_add__(b, seq, len);
+}
+
+static inline bool tty_sgr_add_cap__(tty_sgrbuf__* restrict b, const cap* restrict c)
+{
+    return c->len && tty_sgr_add__(b, c->val, c->len);
+}
+
+/* Terminals with VT220 style SGR can turn attributes and colors off one at a time, like "\033[22m" or "\033[39m" */
+static inline bool tty_sgr_vt220__(void)
+{
+    return tcaps.attr_underline_off.len == 5 && !memcmp(tcaps.attr_underline_off.val, "\033[24m", 5);
+}
+
+static const cap* tty_attr_cap__(unsigned attr)
+{
+    switch (attr) {
+    case TTY_ATTR_BOLD:
+        return &tcaps.attr_bold;
+    case TTY_ATTR_DIM:
+        return &tcaps.attr_dim;
+    case TTY_ATTR_ITALIC:
+        return &tcaps.attr_italic;
+    case TTY_ATTR_UNDERLINE:
+        return &tcaps.attr_underline;
+    case TTY_ATTR_REVERSE:
+        return &tcaps.attr_reverse;
+    default:
+        unreachable();
+    }
+}
+
+/* Turn on attrs. Attributes the terminal doesn't support are skipped. */
+static bool tty_sgr_attrs_on__(tty_sgrbuf__* restrict b, unsigned attrs)
+{
+    for (unsigned attr = TTY_ATTR_BOLD; attr <= TTY_ATTR_REVERSE; attr <<= 1) {
+        if (!(attrs & attr))
+            continue;
+        const cap* c = tty_attr_cap__(attr);
+        if (c->len && !tty_sgr_add_cap__(b, c))
+            return false;
+    }
+    return true;
+}
+
+/* Add a cap that turns off one attribute. Some terminals use a full reset for these, which can't be used here. */
+static bool tty_sgr_add_off__(tty_sgrbuf__* restrict b, const cap* restrict c)
+{
+    if (tty_sgr_shape__(c->val, c->len) && (c->len == 3 || (c->len == 4 && c->val[2] == '0')))
+        return false;
+    return tty_sgr_add_cap__(b, c);
+}
+
+/* Turn off attrs without a reset. Returns false if one of them can only be turned off by a reset.
+ * Bold and dim are turned off together, so one of them may need to be turned back on after.
+ */
+static bool tty_sgr_attrs_off__(tty_sgrbuf__* restrict b, unsigned attrs, unsigned* restrict reenter)
+{
+    if ((attrs & TTY_ATTR_ITALIC) && !tty_sgr_add_off__(b, &tcaps.attr_italic_off))
+        return false;
+    if ((attrs & TTY_ATTR_UNDERLINE) && !tty_sgr_add_off__(b, &tcaps.attr_underline_off))
+        return false;
+    if (!(attrs & (TTY_ATTR_BOLD | TTY_ATTR_DIM | TTY_ATTR_REVERSE)))
+        return true;
+
+    if (!tty_sgr_vt220__())
+        return false;
+    if (attrs & (TTY_ATTR_BOLD | TTY_ATTR_DIM)) {
+        if (!tty_sgr_add__(b, "\033[22m", 5))
+            return false;
+        *reenter = TTY_ATTR_BOLD | TTY_ATTR_DIM;
+    }
+    return !(attrs & TTY_ATTR_REVERSE) || tty_sgr_add__(b, "\033[27m", 5);
+}
+
+/* Set all attributes at once with set_attributes, which also resets the colors on most terminals */
+static bool tty_sgr_attrs_set__(tty_sgrbuf__* restrict b, unsigned attrs)
+{
+    if (!tcaps.attr_set.len)
+        return false;
+
+    // standout, underline, reverse, blink, dim, bold, invisible, protected, alternate charset
+    int params[9] = {0,
+                     (attrs & TTY_ATTR_UNDERLINE) != 0,
+                     (attrs & TTY_ATTR_REVERSE) != 0,
+                     0,
+                     (attrs & TTY_ATTR_DIM) != 0,
+                     (attrs & TTY_ATTR_BOLD) != 0};
+    char buf[TTY_BUF_SIZE];
+    size_t len = tty_run_params__(&tcaps.attr_set, params, 9, buf);
+    if (!len || len > sizeof(buf) || !tty_sgr_add__(b, buf, len))
+        return false;
+    // set_attributes has no parameter for italics
+    return !(attrs & TTY_ATTR_ITALIC) || !tcaps.attr_italic.len || tty_sgr_add_cap__(b, &tcaps.attr_italic);
+}
+
+/* Change the colors in cur to fg and bg. TTY_COLOR_UNKNOWN__ keeps a color as it is. */
+static bool tty_sgr_colors__(tty_sgrbuf__* restrict b, tty_sgrstate__* restrict cur, int fg, int bg)
 {
     if (!tcaps.color_max)
+        return true;
+
+    fg = fg == TTY_COLOR_UNKNOWN__ ? cur->fg : tty_color_resolve__(fg);
+    bg = bg == TTY_COLOR_UNKNOWN__ ? cur->bg : tty_color_resolve__(bg);
+    bool fg_default = fg == TTY_COLOR_DEFAULT && cur->fg != TTY_COLOR_DEFAULT;
+    bool bg_default = bg == TTY_COLOR_DEFAULT && cur->bg != TTY_COLOR_DEFAULT;
+
+    if (fg_default || bg_default) {
+        if (tty_sgr_vt220__()) {
+            if (fg_default && !tty_sgr_add__(b, "\033[39m", 5))
+                return false;
+            if (bg_default && !tty_sgr_add__(b, "\033[49m", 5))
+                return false;
+            cur->fg = fg_default ? TTY_COLOR_DEFAULT : cur->fg;
+            cur->bg = bg_default ? TTY_COLOR_DEFAULT : cur->bg;
+        }
+        else {
+            // orig_pair resets both, the other one is set again below
+            if (!tty_sgr_add_cap__(b, &tcaps.color_default))
+                return false;
+            cur->fg = TTY_COLOR_DEFAULT;
+            cur->bg = TTY_COLOR_DEFAULT;
+        }
+    }
+
+    if (fg != cur->fg) {
+        if (fg == TTY_COLOR_UNKNOWN__ || !tty_sgr_color__(b, fg, false))
+            return false;
+        cur->fg = fg;
+    }
+    if (bg != cur->bg) {
+        if (bg == TTY_COLOR_UNKNOWN__ || !tty_sgr_color__(b, bg, true))
+            return false;
+        cur->bg = bg;
+    }
+    return true;
+}
+
+/* Keep the candidate that was just built if it is the shortest so far, and clear the other buffer for the next */
+static inline void tty_sgr_pick__(tty_sgrbuf__ bufs[static 2], int* restrict best, int* restrict cur, bool ok)
+{
+    if (ok && (*best < 0 || bufs[*cur].len < bufs[*best].len)) {
+        *best = *cur;
+        *cur = !*cur;
+    }
+    bufs[*cur] = (tty_sgrbuf__){.sgr = SIZE_MAX};
+}
+
+static int tty_sgr_write__(const tty_sgrbuf__* restrict b, tty_sgrstate__ next)
+{
+    if (b->len && tty_out_write__(STDOUT_FILENO, b->buf, b->len) == -1)
+        return 1;
+    // set after writing, since what was written is also seen by the parser in tty_cursor_text__
+    tty_sgr__ = next;
+    return 0;
+}
+
+int tty_set_style(tty_style style)
+{
+    unsigned attrs =
+        style.attrs & (TTY_ATTR_BOLD | TTY_ATTR_DIM | TTY_ATTR_ITALIC | TTY_ATTR_UNDERLINE | TTY_ATTR_REVERSE);
+    tty_sgrstate__ target = {
+        .fg = tty_color_resolve__(style.fg), .bg = tty_color_resolve__(style.bg), .attrs = attrs, .attrs_known = true};
+    if (!tcaps.color_max) {
+        target.fg = TTY_COLOR_DEFAULT;
+        target.bg = TTY_COLOR_DEFAULT;
+    }
+    if (tty_sgr__.attrs_known && tty_sgr__.attrs == attrs && tty_sgr__.fg == target.fg && tty_sgr__.bg == target.bg)
         return 0;
 
-    char buf[TTY_BUF_SIZE] = {0};
-    size_t len = unibi_run(tcaps.color_bg_set.val, (unibi_var_t[9]){[0] = unibi_var_from_num(color)}, buf, TTY_BUF_SIZE);
+    // build each way of getting there and keep the one with the fewest bytes
+    tty_sgrbuf__ bufs[2] = {{.sgr = SIZE_MAX}, {.sgr = SIZE_MAX}};
+    int best = -1;
+    int cur = 0;
+
+    // change only what is different, if some attributes can be turned off without a reset
+    if (tty_sgr__.attrs_known) {
+        tty_sgrstate__ state = tty_sgr__;
+        unsigned reenter = 0;
+        bool ok = tty_sgr_attrs_off__(&bufs[cur], state.attrs & ~attrs, &reenter) &&
+                  tty_sgr_attrs_on__(&bufs[cur], attrs & ~(state.attrs & ~reenter)) &&
+                  tty_sgr_colors__(&bufs[cur], &state, target.fg, target.bg);
+        tty_sgr_pick__(bufs, &best, &cur, ok);
+    }
+
+    // reset, then apply everything
+    tty_sgrstate__ state = TTY_SGR_RESET__;
+    bool ok = tty_sgr_add_cap__(&bufs[cur], &tcaps.color_reset) && tty_sgr_attrs_on__(&bufs[cur], attrs) &&
+              tty_sgr_colors__(&bufs[cur], &state, target.fg, target.bg);
+    tty_sgr_pick__(bufs, &best, &cur, ok);
+
+    if (attrs) {
+        state = TTY_SGR_RESET__;
+        ok = tty_sgr_attrs_set__(&bufs[cur], attrs) && tty_sgr_colors__(&bufs[cur], &state, target.fg, target.bg);
+        tty_sgr_pick__(bufs, &best, &cur, ok);
+    }
+
+    if (best < 0)
+        return 1;
+    return tty_sgr_write__(&bufs[best], target);
+}
+
+/* Set the colors that changed in one write, merged into one SGR sequence when the terminal uses SGR for colors */
+static int tty_color_send__(int fg, int bg)
+{
+    if (!tcaps.color_max)
+        return 0;
 
-    if (write(STDOUT_FILENO, buf, len) == -1)
+    tty_sgrbuf__ b = {.sgr = SIZE_MAX};
+    tty_sgrstate__ next = tty_sgr__;
+    if (!tty_sgr_colors__(&b, &next, fg, bg))
         return 1;
-    fflush(stdout);
+    return tty_sgr_write__(&b, next);
+}
+
+int tty_color_set(int color)
+{
+    return tty_color_send__(color, TTY_COLOR_UNKNOWN__);
+}
+
+int tty_color_bg_set(int color)
+{
+    return tty_color_send__(TTY_COLOR_UNKNOWN__, color);
+}
+
+int tty_color_pair_set(int fg, int bg)
+{
+    return tty_color_send__(fg, bg);
+}
+
+int tty_color_rgb_set(unsigned char r, unsigned char g, unsigned char b)
+{
+    return tty_color_send__(TTY_COLOR_RGB(r, g, b), TTY_COLOR_UNKNOWN__);
+}
+
+int tty_color_rgb_bg_set(unsigned char r, unsigned char g, unsigned char b)
+{
+    return tty_color_send__(TTY_COLOR_UNKNOWN__, TTY_COLOR_RGB(r, g, b));
+}
+
+void tty_color_invalidate(void)
+{
+    tty_sgr__ = TTY_SGR_UNKNOWN__;
+}
+
+int tty_color_reset(void)
+{
+    if (tty_sgr__.attrs_known && !tty_sgr__.attrs && tty_sgr__.fg == TTY_COLOR_DEFAULT &&
+        tty_sgr__.bg == TTY_COLOR_DEFAULT)
+        return 0;
+
+    if (tty_send(&tcaps.color_reset))
+        return 1;
+    tty_sgr__ = TTY_SGR_RESET__;
+    return 0;
+}
+
+/* Terminals that report 28 (rectangular editing) in their DA1 reply support DECFRA and DECCRA */
+bool tty_detect_rect_ops(void)
+{
+    if (tty_rect_ops__ == -1) {
+        tty_query_result result;
+        tty_query(TTY_QUERY_DA1, &result);
+    }
+    return tty_rect_ops__ == 1;
+}
+
+/* Erasing gives the same cells as writing ch in style: blanks, in a background the terminal erases with, without
+ * attributes that show on a blank
+ */
+static inline bool tty_fill_erases__(char ch, tty_style style)
+{
+    return ch == ' ' && !(style.attrs & (TTY_ATTR_UNDERLINE | TTY_ATTR_REVERSE)) &&
+           (style.bg == TTY_COLOR_DEFAULT || tcaps.back_color_erase);
+}
+
+/* The sequence that fills a row of a rectangle */
+typedef struct {
+    size_t len;
+    bool literal; /* nothing is shorter than writing the char len times */
+    bool erase;   /* erases instead of writing, so it doesn't move the cursor */
+    char buf[TTY_BUF_SIZE];
+} tty_fillrow__;
+
+static void tty_fill_candidate__(tty_fillrow__* restrict row, const char* restrict seq, size_t len, bool erase)
+{
+    if (!len || len > sizeof(row->buf) || len >= row->len)
+        return;
+    memcpy(row->buf, seq, len);
+    row->len = len;
+    row->literal = false;
+    row->erase = erase;
+}
+
+/* Write ch n times */
+static int tty_fill_literal__(char ch, size_t n)
+{
+    char buf[TTY_BUF_SIZE];
+    memset(buf, ch, sizeof(buf));
+    for (size_t done = 0; done < n;) {
+        size_t len = n - done < sizeof(buf) ? n - done : sizeof(buf);
+        if (tty_out_write__(STDOUT_FILENO, buf, len) == -1)
+            return -1;
+        done += len;
+    }
+    return 0;
+}
+
+int tty_fill_rect(size_t x, size_t y, size_t w, size_t h, char ch, tty_style style)
+{
+    Coordinates size = tty_get_size();
+    if (x >= size.x || y >= size.y)
+        return 0;
+    w = w < size.x - x ? w : size.x - x;
+    h = h < size.y - y ? h : size.y - y;
+    if (!w || !h)
+        return 0;
+    if (ch < 0x20 || ch >= 0x7f || w > INT_MAX)
+        return -1;
+    if (tty_set_style(style))
+        return -1;
+
+    // the sequence that fills a row, the same for every row
+    tty_fillrow__ row = {.len = w, .literal = true};
+    bool erases = tty_fill_erases__(ch, style);
+    if (erases && x + w == size.x)
+        tty_fill_candidate__(&row, tcaps.line_clr_to_eol.val, tcaps.line_clr_to_eol.len, true);
+    char buf[TTY_BUF_SIZE];
+    if (erases && tcaps.line_erase_chars.len)
+        tty_fill_candidate__(&row, buf, tty_run__(&tcaps.line_erase_chars, (int)w, 0, buf), true);
+    if (tcaps.line_repeat_char.len && w > 1) {
+        size_t len = tty_run_params__(&tcaps.line_repeat_char, (int[]){ch, (int)w}, 2, buf);
+        tty_fill_candidate__(&row, buf, len, false);
+    }
+
+    // DECFRA fills the whole rectangle in one sequence, only used once a DA1 reply said the terminal has it
+    if (h > 1 && tty_rect_ops__ == 1) {
+        char decfra[64];
+        int len = snprintf(decfra, sizeof(decfra), "\033[%d;%zu;%zu;%zu;%zu$x", ch, y + 1, x + 1, y + h, x + w);
+        // moving to each row is at least as long as absolute addressing, roughly
+        size_t rows = h * (row.len + tcaps.cursor_pos.len);
+        if (len > 0 && (size_t)len < rows)
+            return tty_out_write__(STDOUT_FILENO, decfra, (size_t)len) == -1 ? -1 : 0;
+    }
+
+    // writing the last cell on terminals that wrap right away would scroll the screen
+    bool bottom_right = x + w == size.x && y + h == size.y && tcaps.auto_right_margin && !tcaps.eat_newline_glitch;
+    for (size_t i = 0; i < h; ++i) {
+        if (tty_move_to(x, y + i))
+            return -1;
+
+        bool last = bottom_right && i == h - 1 && !row.erase;
+        int rc;
+        if (row.literal || last)
+            rc = tty_fill_literal__(ch, last ? w - 1 : w);
+        else
+            rc = tty_out_write__(STDOUT_FILENO, row.buf, row.len) == -1 ? -1 : 0;
+        if (rc)
+            return -1;
+        // so the last cell is written one to the left, and pushed into place by inserting a char before it
+        if (last && w > 1 && (tcaps.line_ins_char.len || tcaps.line_ins_chars.len) &&
+            (tty_move_to(size.x - 2, y + i) || tty_insert_chars(1) == -1 || tty_fill_literal__(ch, 1)))
+            return -1;
+    }
     return 0;
 }
+
+int tty_copy_rect(size_t x, size_t y, size_t w, size_t h, size_t to_x, size_t to_y)
+{
+    Coordinates size = tty_get_size();
+    if (x >= size.x || y >= size.y || to_x >= size.x || to_y >= size.y)
+        return 0;
+    // clip both rectangles to the screen
+    size_t max_x = size.x - (x > to_x ? x : to_x);
+    size_t max_y = size.y - (y > to_y ? y : to_y);
+    w = w < max_x ? w : max_x;
+    h = h < max_y ? h : max_y;
+    if (!w || !h || (x == to_x && y == to_y))
+        return 0;
+    if (tty_rect_ops__ != 1)
+        return -1;
+
+    // DECCRA: source top, left, bottom, right, page, then destination top, left, page. Doesn't move the cursor.
+    char deccra[96];
+    int len = snprintf(deccra, sizeof(deccra), "\033[%zu;%zu;%zu;%zu;1;%zu;%zu;1$v", y + 1, x + 1, y + h, x + w,
+                       to_y + 1, to_x + 1);
+    if (len <= 0 || (size_t)len >= sizeof(deccra))
+        return -1;
+    return tty_out_write__(STDOUT_FILENO, deccra, (size_t)len) == -1 ? -1 : 0;
+}
+
+#define TTY_SYNC_BEGIN__ "\033[?2026h"
+#define TTY_SYNC_END__ "\033[?2026l"
+
+/* Mode 2026 is supported if DECRQM says it's set or reset, not if it is unknown or permanently set or reset */
+static bool tty_sync_supported__(void)
+{
+    if (tty_sync__ == -1) {
+        tty_query_result result;
+        tty_sync__ = (tty_query(TTY_QUERY_SYNC, &result) & TTY_QUERY_SYNC) && (result.sync == 1 || result.sync == 2);
+    }
+    return tty_sync__ == 1;
+}
+
+void tty_begin_frame(void)
+{
+    if (tty_out__.frames++)
+        return;
+
+    // asking first, since the query flushes what's pending
+    bool sync = tty_sync_supported__();
+    tty_out__.frame_policy = tty_out__.policy;
+    if (tty_out__.policy == TTY_FLUSH_IMMEDIATE || tty_out__.policy == TTY_FLUSH_LINE)
+        tty_set_flush_policy(TTY_FLUSH_FRAME);
+    if (!sync)
+        return;
+    tty_out__.frame_start = tty_out__.len;
+    tty_out__.frame_flushed = false;
+    if (tcaps.sync_begin.len)
+        tty_send(&tcaps.sync_begin);
+    else
+        tty_write(TTY_SYNC_BEGIN__, sizeof(TTY_SYNC_BEGIN__) - 1);
+    tty_out__.frame_body = tty_out__.len;
+}
+
+int tty_end_frame(void)
+{
+    if (!tty_out__.frames || --tty_out__.frames)
+        return 0;
+
+    if (tty_sync__ == 1 && !tty_out__.frame_flushed && tty_out__.len == tty_out__.frame_body) {
+        // nothing drawn, drop the begin sequence instead of sending an empty frame
+        tty_out__.len = tty_out__.frame_start;
+    }
+    else if (tty_sync__ == 1) {
+        if (tcaps.sync_end.len)
+            tty_send(&tcaps.sync_end);
+        else
+            tty_write(TTY_SYNC_END__, sizeof(TTY_SYNC_END__) - 1);
+    }
+    int rc = tty_flush();
+    if (tty_out__.frame_policy != tty_out__.policy)
+        tty_set_flush_policy(tty_out__.frame_policy);
+    return rc;
+}
@@ -15,6 +15,16 @@
 #   define TTYIO_RED_ERROR 196
 #endif
 
+/* Default size in bytes the output buffer can grow to before it is automatically flushed */
+#ifndef TTYIO_HIGH_WATER
+#   define TTYIO_HIGH_WATER 16384
+#endif
+
+/* How long tty_query waits for replies, in milliseconds. Can be changed at runtime with tty_set_query_timeout. */
+#ifndef TTYIO_QUERY_TIMEOUT
+#   define TTYIO_QUERY_TIMEOUT 500
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif // __cplusplus
@@ -42,10 +52,142 @@ enum input_type {
 };
 #endif /* C23 */
 
+/* enum tty_flush_policy
+ * Immediate: every output call is written right away. The default.
+ * Line: output to stdout is buffered and flushed at the end of each line.
+ * Frame: output to stdout is buffered and only flushed by tty_flush, or when the buffer passes its high-water mark.
+ * Idle: like frame, but also flushed when waiting for input (tty_read, tty_get_pos).
+ */
+#if __STDC_VERSION__ >= 202311L /* C23 */
+enum tty_flush_policy: short {
+    TTY_FLUSH_IMMEDIATE = 0,
+    TTY_FLUSH_LINE = 1,
+    TTY_FLUSH_FRAME = 2,
+    TTY_FLUSH_IDLE = 3
+};
+#else
+enum tty_flush_policy {
+    TTY_FLUSH_IMMEDIATE = 0,
+    TTY_FLUSH_LINE = 1,
+    TTY_FLUSH_FRAME = 2,
+    TTY_FLUSH_IDLE = 3
+};
+#endif /* C23 */
+
+/* enum tty_query
+ * Queries sent by tty_query, can be combined so they are all sent in one write and cost one round-trip.
+ * Pos: cursor position (DSR 6n).
+ * DA1: primary device attributes. Always sent last since every terminal answers it, its reply ends the query.
+ * Size: window size in cells (CSI 18t).
+ * Version: terminal name and version (XTVERSION).
+ * Sync: whether synchronized output (mode 2026) is supported (DECRQM).
+ */
+#if __STDC_VERSION__ >= 202311L /* C23 */
+enum tty_query: short {
+    TTY_QUERY_POS = 1,
+    TTY_QUERY_DA1 = 2,
+    TTY_QUERY_SIZE = 4,
+    TTY_QUERY_VERSION = 8,
+    TTY_QUERY_SYNC = 16
+};
+#else
+enum tty_query {
+    TTY_QUERY_POS = 1,
+    TTY_QUERY_DA1 = 2,
+    TTY_QUERY_SIZE = 4,
+    TTY_QUERY_VERSION = 8,
+    TTY_QUERY_SYNC = 16
+};
+#endif /* C23 */
+
+#define TTY_QUERY_DA1_MAX 16
+
+/* enum tty_attr
+ * Text attributes for tty_style, can be combined.
+ */
+#if __STDC_VERSION__ >= 202311L /* C23 */
+enum tty_attr: short {
+    TTY_ATTR_NONE = 0,
+    TTY_ATTR_BOLD = 1,
+    TTY_ATTR_DIM = 2,
+    TTY_ATTR_ITALIC = 4,
+    TTY_ATTR_UNDERLINE = 8,
+    TTY_ATTR_REVERSE = 16
+};
+#else
+enum tty_attr {
+    TTY_ATTR_NONE = 0,
+    TTY_ATTR_BOLD = 1,
+    TTY_ATTR_DIM = 2,
+    TTY_ATTR_ITALIC = 4,
+    TTY_ATTR_UNDERLINE = 8,
+    TTY_ATTR_REVERSE = 16
+};
+#endif /* C23 */
+
+/* The terminal's default foreground or background color */
+#define TTY_COLOR_DEFAULT -1
+/* A 24-bit color that can be used anywhere a color number can, like in tty_style */
+#define TTY_COLOR_RGB(r, g, b) (0x1000000 | ((int)(r) & 0xff) << 16 | ((int)(g) & 0xff) << 8 | ((int)(b) & 0xff))
+
+typedef struct {
+    int fg; // color number or TTY_COLOR_DEFAULT
+    int bg;
+    unsigned attrs; // enum tty_attr flags
+} tty_style;
+
+/* Replies to tty_query. Only the fields for queries in answered are set. */
+typedef struct {
+    unsigned answered;
+    Coordinates pos;  // x is 1 based and y is 0 based, like tty_get_pos
+    Coordinates size; // columns and rows
+    size_t da1_len;
+    int da1[TTY_QUERY_DA1_MAX]; // device class followed by supported features, like 22 for ANSI color
+    char version[64];          // like "XTerm(390)"
+    int sync;                  // mode 2026: 0 not recognized, 1 set, 2 reset, 3 permanently set, 4 permanently reset
+} tty_query_result;
+
 extern termcaps tcaps;
 
+/* Called with the new size when the terminal is resized */
+typedef void (*tty_resize_callback)(Coordinates size, void* data);
+
+/* Size of the terminal in columns (x) and rows (y).
+ * Cached, and only reloaded after a SIGWINCH, so it is cheap to call many times per frame.
+ * Falls back to the size in terminfo, then 80x24, when stdout isn't a terminal.
+ */
 Coordinates tty_get_size(void);
+/* Incremented every time the size changes, so renderers can check if the size changed since their last frame */
+unsigned long tty_get_size_generation(void);
+/* Set a callback for size changes, NULL to remove it. It isn't called from the signal handler, but the next time
+ * the size is checked by tty_get_size or tty_get_size_generation.
+ */
+void tty_set_resize_callback(tty_resize_callback callback, void* data);
+/* x and y of the position returned by tty_get_pos and tty_sync_pos when the terminal didn't report it before the
+ * query timeout
+ */
+#define TTY_POS_UNKNOWN ((size_t)-1)
+/* Cursor position, x is 1 based and y is 0 based.
+ * ttyio tracks the cursor through everything it writes to stdout, so the terminal is only queried when the
+ * position isn't known yet, or after tty_pos_invalidate.
+ * A report outside the screen is taken for a key press, but a modified F3 (ESC [ 1 ; mod R) pressed while waiting
+ * can't be told apart from a position on the first row.
+ */
 Coordinates tty_get_pos(void);
+/* Query the terminal for the cursor position and resync the tracked position with it. TTY_POS_UNKNOWN on timeout. */
+Coordinates tty_sync_pos(void);
+/* Forget the tracked position, call after writing to the terminal without ttyio, e.g. with printf or a child
+ * process, so the next tty_get_pos queries the terminal.
+ */
+void tty_pos_invalidate(void);
+
+/* Send queries, a mask of enum tty_query, and wait up to the query timeout for the replies.
+ * User input that arrives while waiting is kept and returned by tty_read.
+ * Returns the mask of queries that were answered.
+ */
+unsigned tty_query(unsigned queries, tty_query_result* restrict result);
+void tty_set_query_timeout(int timeout_ms);
+int tty_get_query_timeout(void);
 
 /* Just init term and tcaps */
 void tty_init_caps(void);
@@ -61,8 +203,74 @@ void tty_deinit_input_mode(void);
 /* Deinit everything (reset input mode and free internally used memory) */
 void tty_deinit(void);
 
+/* Flush policy, honored by all output functions. See enum tty_flush_policy. */
+void tty_set_flush_policy(enum tty_flush_policy policy);
+enum tty_flush_policy tty_get_flush_policy(void);
+
+/* Buffered output: when enabled, output going to stdout is appended to an internal buffer instead of being written
+ * immediately. The buffer is written with a single write() on tty_flush, or automatically when it grows past
+ * high_water bytes (0 uses TTYIO_HIGH_WATER). Uses TTY_FLUSH_FRAME unless another buffered policy is already set.
+ */
+void tty_buffer_enable(size_t high_water);
+/* Flushes anything pending, then returns to writing output immediately (TTY_FLUSH_IMMEDIATE) */
+void tty_buffer_disable(void);
+/* Returned by tty_flush when stdout is non-blocking and the terminal didn't take everything. The rest stays buffered
+ * and is written first by the next flush, so wait for stdout to be writable (POLLOUT) and flush again.
+ */
+#define TTY_PENDING 2
+/* Write everything buffered. Returns 0, 1 on error, or TTY_PENDING. Nothing is dropped on error: what wasn't written
+ * stays buffered, as with TTY_PENDING, and the next flush tries again. tty_buffer_disable discards it.
+ */
+int tty_flush(void);
+/* Flush, and when non-blocking, wait until the terminal took everything */
+int tty_drain(void);
+
+/* Non-blocking output: makes stdout non-blocking, so a terminal or connection that can't keep up doesn't stall the
+ * process in write(). Output functions write what the terminal takes and queue the rest in the output buffer, see
+ * TTY_PENDING. Turning it off waits for pending output. Not supported on Windows.
+ * A terminal's stdin and stdout are usually one open file, so when stdout is a terminal it is reopened and the new
+ * file replaces STDOUT_FILENO until this is turned off, stdin stays blocking. Otherwise, or if the terminal can't be
+ * reopened, O_NONBLOCK is set on stdout's open file, and a stdin sharing it becomes non-blocking too: tty_read still
+ * waits for input, but other reads of stdin can fail with EAGAIN. stdout made non-blocking some other way is handled
+ * the same.
+ */
+int tty_set_nonblocking(bool nonblocking);
+/* Bytes of output that haven't reached the terminal yet: buffered, plus queued in the tty driver (TIOCOUTQ) */
+size_t tty_output_pending(void);
+/* stdout can take more output without blocking. Ptys don't report their queue, but stop being writable when full. */
+bool tty_output_ready(void);
+
+/* io_uring output backend (Linux, compiled in with -DTTYIO_IO_URING): output to every fd is copied into a queue per fd,
+ * and the queues of all fds are submitted together with one io_uring_enter, the writes completing asynchronously.
+ * For processes writing to many fds, like multiplexers feeding ptys. Output to stdout is submitted when it would have
+ * been written, on every write unbuffered or on tty_flush buffered. Output to other fds, like tty_dwrite, only goes out
+ * on the next tty_uring_submit, tty_uring_wait or tty_flush, even when nothing is buffered for stdout.
+ * Output calls return once the output is queued. Writes that failed are reported by the next of those three calls.
+ * tty_uring_enable returns -1 when io_uring isn't available or compiled in, output then keeps using write().
+ */
+#ifndef TTYIO_URING_ENTRIES
+#   define TTYIO_URING_ENTRIES 256
+#endif /* ifndef TTYIO_URING_ENTRIES */
+
+/* Set up the ring with entries submission queue entries, 0 uses TTYIO_URING_ENTRIES */
+int tty_uring_enable(unsigned entries);
+/* Wait for everything queued to be written, then go back to write() */
+void tty_uring_disable(void);
+bool tty_uring_enabled(void);
+/* Submit what is queued for all fds without waiting for it to be written. Returns -1, with errno set, on error or if
+ * a write that completed since the last call failed.
+ */
+int tty_uring_submit(void);
+/* Submit and wait until everything queued was written. Returns -1, with errno set, if a write failed. */
+int tty_uring_wait(void);
+
+/* Input, read from stdin. Flushes pending output first when using TTY_FLUSH_LINE or TTY_FLUSH_IDLE.
+ * Input that arrived while waiting for tty_query replies is returned first.
+ */
+int tty_read(char* restrict buf, size_t n);
+
 /* Output, tracks pos of cursor for you and stores in term */
-int tty_putc_invis();
+int tty_putc_invis(void);
 int tty_putc(char c);
 int tty_fputc(FILE* restrict file, char c);
 int tty_dputc(int fd, char c);
@@ -74,6 +282,19 @@ int tty_fwriteln(FILE* restrict file, const char* restrict buf, size_t n);
 int tty_dwrite(int fd, const char* restrict buf, size_t n);
 int tty_dwriteln(int fd, const char* restrict buf, size_t n);
 
+/* Vectored output: write several buffers, like a prefix, a payload and a suffix, in one writev without copying them.
+ * Buffered output to stdout appends them, unless they would pass the high-water mark, then they are written in one
+ * writev together with what is buffered. Returns the number of bytes written, or EOF.
+ */
+typedef struct {
+    const char* buf;
+    size_t len;
+} tty_iovec;
+
+int tty_writev(const tty_iovec* restrict iov, size_t n);
+int tty_fwritev(FILE* restrict file, const tty_iovec* restrict iov, size_t n);
+int tty_dwritev(int fd, const tty_iovec* restrict iov, size_t n);
+
 int tty_puts(const char* restrict str);
 int tty_fputs(const char* restrict str, FILE* restrict file);
 
@@ -96,15 +317,81 @@ int tty_perror(const char* restrict msg);
 int tty_send(cap* restrict c);
 int tty_dsend(int fd, cap* restrict c);
 int tty_fsend(cap* restrict c, FILE* restrict file);
+/* Output a parameterized cap, like tcaps.scroll_region, with up to 9 params. Returns -1 if it isn't supported. */
+int tty_send_parm(cap* restrict c, const int* restrict params, size_t n);
+int tty_dsend_parm(int fd, cap* restrict c, const int* restrict params, size_t n);
 void tty_send_n(cap* restrict c, size_t n);
 void tty_dsend_n(int fd, cap* restrict c, size_t n);
 void tty_fsend_n(cap* restrict c, size_t n, FILE* restrict file);
 
+/* Insert or delete lines at the cursor's line, moving the cursor to the start of the line,
+ * or insert or delete chars at the cursor, which doesn't move. Uses whichever of the single and parameterized caps
+ * is shorter. Returns -1 if the terminal can't.
+ */
+int tty_insert_lines(size_t n);
+int tty_delete_lines(size_t n);
+int tty_insert_chars(size_t n);
+int tty_delete_chars(size_t n);
+
+/* Move the cursor to column x and row y, both 0 based.
+ * Uses the tracked cursor position to pick the shortest sequence out of absolute addressing, row and column
+ * addressing, relative moves, carriage return plus relative moves, and home plus relative moves.
+ */
+int tty_move_to(size_t x, size_t y);
+
 /* Colors */
-/* Colors don't have a fallback. If tcaps.color_max is 0, no color is set. */
+/* Colors don't have a fallback. If tcaps.color_max is 0, no color is set.
+ * ttyio remembers the colors it set, so setting the color the terminal already has writes nothing.
+ */
 int tty_color_set(int color);
 int tty_color_bg_set(int color);
-#define tty_color_reset() tty_send(&tcaps.color_reset)
+/* Set foreground and background together, in one SGR sequence when the terminal supports it */
+int tty_color_pair_set(int fg, int bg);
+/* 24-bit colors. Sent as is when the terminal supports them (tcaps.color_rgb),
+ * otherwise the nearest color in the terminal's palette is used.
+ */
+int tty_color_rgb_set(unsigned char r, unsigned char g, unsigned char b);
+int tty_color_rgb_bg_set(unsigned char r, unsigned char g, unsigned char b);
+/* Reset colors and attributes */
+int tty_color_reset(void);
+/* Forget the colors and attributes ttyio set, call after setting them without ttyio, e.g. with printf */
+void tty_color_invalidate(void);
+
+/* Styles */
+/* Set colors and attributes, writing the fewest bytes to get there from the current style.
+ * Attributes that can't be turned off alone on the terminal are turned off by a reset, then the rest reapplied.
+ * Attributes the terminal doesn't support are ignored.
+ */
+int tty_set_style(tty_style style);
+
+/* Frames */
+/* Output between tty_begin_frame and tty_end_frame is buffered and written in one write by tty_end_frame.
+ * On terminals with synchronized output (the Sync extended cap, or mode 2026 per DECRQM, asked the first time a frame
+ * begins) the frame is wrapped in begin and end sequences, so the terminal draws it all at once without tearing.
+ * Frames can be nested, only the outermost one counts.
+ */
+void tty_begin_frame(void);
+int tty_end_frame(void);
+
+/* Rectangles */
+/* Whether the terminal reports rectangular editing (DECFRA, DECCRA) in its DA1 reply. Every tty_query gets a DA1
+ * reply, so after the first query it is known without asking again. Otherwise this queries the terminal, so call it
+ * at startup: tty_fill_rect and tty_copy_rect never query, and don't use rectangle operations until it is known.
+ */
+bool tty_detect_rect_ops(void);
+/* Fill w by h cells starting at column x and row y, both 0 based, with ch in style.
+ * Picks the fewest bytes out of erasing (clr_eol with bce, erase_chars), repeat_char, DECFRA on terminals that
+ * report rectangular editing, or writing ch. Clipped to the screen. Returns -1 if ch isn't printable ASCII.
+ * On terminals that wrap as soon as the last column is written (auto_right_margin without eat_newline_glitch), the
+ * bottom-right cell is filled by inserting a char before it. Without insert_character, or if it is the only cell in
+ * its row of the rectangle, it is left as it was, unless it can be erased.
+ */
+int tty_fill_rect(size_t x, size_t y, size_t w, size_t h, char ch, tty_style style);
+/* Copy w by h cells at column x and row y to column to_x and row to_y on the terminal, with DECCRA.
+ * The rectangles can overlap. Clipped to the screen. Returns -1 if the terminal isn't known to support rectangular
+ * editing, see tty_detect_rect_ops, then the destination has to be redrawn instead.
+ */
+int tty_copy_rect(size_t x, size_t y, size_t w, size_t h, size_t to_x, size_t to_y);
 
 #ifdef __cplusplus
 }
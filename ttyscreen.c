@@ -0,0 +1,663 @@
+/* Copyright ttyio (C) by Alex Eski 2025 */
+/* Licensed under GPLv3, see LICENSE for more information. */
+/* ttyscreen.c: double-buffered screen layer, writes only the cells that changed between presents */
+
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif /* ifndef _POSIX_C_SOURCE */
+
+#include <errno.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tcaps.h"
+#include "ttyio.h"
+#include "ttyplatform.h" // used for macros
+#include "ttyscreen.h"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TTY_SCREEN_SSE2__ 1
+#endif
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <fcntl.h>
+#include <time.h>
+#else
+#include <windows.h>
+#endif /* if !defined(_WIN32) && !defined(_WIN64) */
+
+/* tty_invalidate can be called from any thread */
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define tty_atomic_xchg__(p, v) _InterlockedExchange((p), (v))
+#define tty_atomic_load__(p) _InterlockedOr((p), 0)
+#else
+#define tty_atomic_xchg__(p, v) __atomic_exchange_n((p), (v), __ATOMIC_ACQ_REL)
+#define tty_atomic_load__(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#endif
+
+/* Per row state, so rows that weren't drawn into since the last present are skipped without looking at their cells */
+typedef struct {
+    uint64_t front_hash; /* hash of the row on the terminal */
+    uint64_t back_hash;  /* hash of the row in the back buffer, as of the last present */
+    bool dirty;          /* drawn into since the last present */
+} tty_row__;
+
+/* The back buffer is what the app drew, the front buffer is what is on the terminal */
+typedef struct {
+    size_t w;
+    size_t h;
+    unsigned long gen; /* size generation the buffers were allocated for */
+    bool full;         /* the front buffer doesn't match the terminal, clear and redraw everything */
+    tty_cell* front;
+    tty_cell* back;
+    tty_row__* rows;
+    uint64_t blank_hash; /* hash of a row of blanks */
+} tty_screen__;
+
+static tty_screen__ scr__;
+/* Frames are skipped while more output than this hasn't reached the terminal yet, 0 never skips */
+static size_t scr_backlog__ = TTYSCREEN_BACKLOG;
+
+/* Smallest rectangle worth copying on the terminal, smaller ones are cheaper to redraw than the copy sequence */
+#define TTY_SCREEN_COPY_MIN__ 32
+
+#define TTY_CELL_BLANK__                                                                                               \
+    (tty_cell)                                                                                                         \
+    {                                                                                                                  \
+        .glyph = " ", .len = 1, .fg = TTY_COLOR_DEFAULT, .bg = TTY_COLOR_DEFAULT                                       \
+    }
+
+/* Index of the first cell that differs between two rows of n cells, n if they are the same */
+static size_t tty_row_diff__(const tty_cell* restrict a, const tty_cell* restrict b, size_t n)
+{
+    size_t i = 0;
+#ifdef TTY_SCREEN_SSE2__
+    // a cell is 16 bytes, one load each. Check 4 cells at a time, then find the cell that differs.
+    for (; i + 4 <= n; i += 4) {
+        const __m128i* x = (const __m128i*)(const void*)&a[i];
+        const __m128i* y = (const __m128i*)(const void*)&b[i];
+        __m128i eq = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128(x), _mm_loadu_si128(y)),
+                                                 _mm_cmpeq_epi8(_mm_loadu_si128(x + 1), _mm_loadu_si128(y + 1))),
+                                   _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128(x + 2), _mm_loadu_si128(y + 2)),
+                                                 _mm_cmpeq_epi8(_mm_loadu_si128(x + 3), _mm_loadu_si128(y + 3))));
+        if (_mm_movemask_epi8(eq) != 0xffff)
+            break;
+    }
+#endif /* TTY_SCREEN_SSE2__ */
+    for (; i < n; ++i) {
+        if (memcmp(&a[i], &b[i], sizeof(tty_cell)))
+            return i;
+    }
+    return n;
+}
+
+static uint64_t tty_row_hash__(const tty_cell* restrict row, size_t n)
+{
+    uint64_t h = 0;
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t words[sizeof(tty_cell) / sizeof(uint64_t)];
+        memcpy(words, &row[i], sizeof(words));
+        for (size_t j = 0; j < sizeof(words) / sizeof(uint64_t); ++j) {
+            h = ((h << 5 | h >> 59) ^ words[j]) * 0x9e3779b97f4a7c15u;
+        }
+    }
+    return h;
+}
+
+/* Every row was drawn into */
+static void tty_rows_dirty__(void)
+{
+    for (size_t y = 0; y < scr__.h; ++y) {
+        scr__.rows[y].dirty = true;
+    }
+}
+
+static inline bool tty_cell_style_eq__(const tty_cell* restrict c, tty_style style)
+{
+    return c->fg == style.fg && c->bg == style.bg && c->attrs == style.attrs;
+}
+
+static inline tty_style tty_cell_style__(const tty_cell* restrict c)
+{
+    return (tty_style){.fg = c->fg, .bg = c->bg, .attrs = c->attrs};
+}
+
+/* (Re)allocate the buffers for the current size, keeping what was drawn in the back buffer where it still fits */
+static int tty_screen_alloc__(void)
+{
+    Coordinates size = tty_get_size();
+    size_t n = size.x * size.y;
+    tty_cell* front = malloc(n * sizeof(tty_cell));
+    tty_cell* back = malloc(n * sizeof(tty_cell));
+    tty_row__* rows = calloc(size.y, sizeof(tty_row__));
+    if (!front || !back || !rows) {
+        free(front);
+        free(back);
+        free(rows);
+        return 1;
+    }
+
+    for (size_t y = 0; y < size.y; ++y) {
+        for (size_t x = 0; x < size.x; ++x) {
+            size_t i = y * size.x + x;
+            front[i] = TTY_CELL_BLANK__;
+            back[i] = scr__.back && x < scr__.w && y < scr__.h ? scr__.back[y * scr__.w + x] : TTY_CELL_BLANK__;
+        }
+    }
+
+    free(scr__.front);
+    free(scr__.back);
+    free(scr__.rows);
+    scr__ = (tty_screen__){.w = size.x,
+                           .h = size.y,
+                           .gen = tty_get_size_generation(),
+                           .full = true,
+                           .front = front,
+                           .back = back,
+                           .rows = rows};
+    scr__.blank_hash = tty_row_hash__(front, size.x);
+    return 0;
+}
+
+int tty_screen_init(void)
+{
+    tty_screen_deinit();
+    return tty_screen_alloc__();
+}
+
+void tty_screen_deinit(void)
+{
+    free(scr__.front);
+    free(scr__.back);
+    free(scr__.rows);
+    scr__ = (tty_screen__){0};
+}
+
+Coordinates tty_screen_size(void)
+{
+    return (Coordinates){.x = scr__.w, .y = scr__.h};
+}
+
+void tty_screen_clear(void)
+{
+    for (size_t i = 0; i < scr__.w * scr__.h; ++i) {
+        scr__.back[i] = TTY_CELL_BLANK__;
+    }
+    tty_rows_dirty__();
+}
+
+void tty_screen_put(size_t x, size_t y, const char* restrict glyph, size_t len, tty_style style)
+{
+    if (x >= scr__.w || y >= scr__.h)
+        return;
+
+    scr__.rows[y].dirty = true;
+    tty_cell* c = &scr__.back[y * scr__.w + x];
+    *c = (tty_cell){.len = 1, .attrs = (unsigned char)style.attrs, .fg = style.fg, .bg = style.bg};
+    if (!len || len > sizeof(c->glyph)) {
+        c->glyph[0] = ' ';
+        return;
+    }
+    memcpy(c->glyph, glyph, len);
+    c->len = (unsigned char)len;
+}
+
+/* Length of the UTF-8 sequence at str, 0 if it isn't valid */
+static size_t tty_utf8_len__(const unsigned char* restrict str)
+{
+    size_t len = str[0] < 0x80            ? 1
+                 : (str[0] & 0xe0) == 0xc0 ? 2
+                 : (str[0] & 0xf0) == 0xe0 ? 3
+                 : (str[0] & 0xf8) == 0xf0 ? 4
+                                           : 0;
+    for (size_t i = 1; i < len; ++i) {
+        if ((str[i] & 0xc0) != 0x80)
+            return 0;
+    }
+    return len;
+}
+
+size_t tty_screen_print(size_t x, size_t y, tty_style style, const char* restrict str)
+{
+    size_t start = x;
+    const unsigned char* s = (const unsigned char*)str;
+    while (*s && x < scr__.w) {
+        size_t len = tty_utf8_len__(s);
+        if (!len || *s < 0x20 || *s == 0x7f) {
+            // control chars and invalid UTF-8 would mess up the screen
+            tty_screen_put(x++, y, "?", 1, style);
+            s += len ? len : 1;
+            continue;
+        }
+        tty_screen_put(x++, y, (const char*)s, len, style);
+        s += len;
+    }
+    return x - start;
+}
+
+void tty_screen_fill(size_t x, size_t y, size_t w, size_t h, const char* restrict glyph, size_t len, tty_style style)
+{
+    for (size_t row = y; row < y + h && row < scr__.h; ++row) {
+        for (size_t col = x; col < x + w && col < scr__.w; ++col) {
+            tty_screen_put(col, row, glyph, len, style);
+        }
+    }
+}
+
+/* Copy a rectangle of cells in buf, rows in the order that doesn't overwrite rows still to be copied */
+static void tty_screen_copy_cells__(tty_cell* restrict buf, size_t x, size_t y, size_t w, size_t h, size_t to_x,
+                                    size_t to_y)
+{
+    for (size_t i = 0; i < h; ++i) {
+        size_t row = to_y > y ? h - 1 - i : i;
+        memmove(&buf[(to_y + row) * scr__.w + to_x], &buf[(y + row) * scr__.w + x], w * sizeof(tty_cell));
+    }
+}
+
+void tty_screen_copy(size_t x, size_t y, size_t w, size_t h, size_t to_x, size_t to_y)
+{
+    if (x >= scr__.w || y >= scr__.h || to_x >= scr__.w || to_y >= scr__.h)
+        return;
+    size_t max_x = scr__.w - (x > to_x ? x : to_x);
+    size_t max_y = scr__.h - (y > to_y ? y : to_y);
+    w = w < max_x ? w : max_x;
+    h = h < max_y ? h : max_y;
+    if (!w || !h || (x == to_x && y == to_y))
+        return;
+
+    tty_screen_copy_cells__(scr__.back, x, y, w, h, to_x, to_y);
+    for (size_t row = to_y; row < to_y + h; ++row) {
+        scr__.rows[row].dirty = true;
+    }
+
+    // when the terminal can copy the cells itself, the front buffer follows it and the next present only draws what
+    // the copy didn't get right. Otherwise the next present redraws the destination. The copy is output right away,
+    // so not while presents are being skipped for a terminal that can't keep up.
+    if (scr__.full || w * h < TTY_SCREEN_COPY_MIN__ || tty_screen_backlogged() || tty_copy_rect(x, y, w, h, to_x, to_y))
+        return;
+    tty_screen_copy_cells__(scr__.front, x, y, w, h, to_x, to_y);
+    for (size_t row = to_y; row < to_y + h; ++row) {
+        scr__.rows[row].front_hash = tty_row_hash__(&scr__.front[row * scr__.w], scr__.w);
+    }
+}
+
+void tty_screen_invalidate(void)
+{
+    scr__.full = true;
+}
+
+/* Instead of moving the cursor right over unchanged cells, write them again when that is fewer bytes.
+ * Only when they are in the current style, so no SGR sequences are needed.
+ */
+static bool tty_screen_overwrite__(size_t y, size_t from, size_t to, const tty_cell* restrict style)
+{
+    const tty_cell* row = &scr__.front[y * scr__.w];
+    size_t bytes = 0;
+    for (size_t x = from; x < to; ++x) {
+        if (!tty_cell_style_eq__(&row[x], tty_cell_style__(style)))
+            return false;
+        bytes += row[x].len;
+        if (bytes > tcaps.cursor_right.len)
+            return false;
+    }
+
+    for (size_t x = from; x < to; ++x) {
+        tty_write(row[x].glyph, row[x].len);
+    }
+    return true;
+}
+
+/* A block of rows that moved: back rows [start, start + len) are the front rows starting at start + shift */
+typedef struct {
+    size_t start;
+    size_t len;
+    ptrdiff_t shift;
+    size_t gain; /* rows in the block that would have to be redrawn without scrolling */
+} tty_scroll__;
+
+/* Find the block of moved rows that saves the most redrawing, like the ncurses hashmap.
+ * Rows are matched by hash, then compared cell by cell, so a hash collision can't scroll the wrong rows.
+ */
+static tty_scroll__ tty_screen_find_scroll__(void)
+{
+    tty_scroll__ best = {0};
+    tty_row__* rows = scr__.rows;
+    size_t h = scr__.h;
+    for (size_t y = 0; y < h;) {
+        uint64_t hash = rows[y].back_hash;
+        if (hash == rows[y].front_hash || hash == scr__.blank_hash) {
+            ++y;
+            continue;
+        }
+
+        // where the row was, looking closest first since scrolls are usually small
+        size_t from = SIZE_MAX;
+        for (size_t d = 1; d < h && from == SIZE_MAX; ++d) {
+            if (y + d < h && rows[y + d].front_hash == hash)
+                from = y + d;
+            else if (y >= d && rows[y - d].front_hash == hash)
+                from = y - d;
+        }
+        if (from == SIZE_MAX) {
+            ++y;
+            continue;
+        }
+
+        tty_scroll__ block = {.start = y, .shift = (ptrdiff_t)from - (ptrdiff_t)y};
+        while (y + block.len < h && from + block.len < h &&
+               rows[y + block.len].back_hash == rows[from + block.len].front_hash &&
+               tty_row_diff__(&scr__.back[(y + block.len) * scr__.w], &scr__.front[(from + block.len) * scr__.w],
+                              scr__.w) == scr__.w) {
+            block.gain += rows[y + block.len].back_hash != rows[y + block.len].front_hash &&
+                          rows[y + block.len].back_hash != scr__.blank_hash;
+            ++block.len;
+        }
+        if (block.gain > best.gain)
+            best = block;
+        y += block.len ? block.len : 1;
+    }
+    return best;
+}
+
+/* Without a scroll region, deleting lines above the rows and inserting lines below them scrolls them just the same */
+static bool tty_screen_scroll_lines__(size_t top, size_t bottom, size_t n, bool forward)
+{
+    bool insert = tcaps.line_insert.len || tcaps.line_insert_n.len;
+    bool delete = tcaps.line_delete.len || tcaps.line_delete_n.len;
+    // at the bottom of the screen, deleted lines are replaced by blank lines without inserting
+    bool to_end = bottom == scr__.h - 1;
+    if (!delete || (!insert && (!forward || !to_end)))
+        return false;
+
+    // delete before inserting, so no rows are pushed off the bottom of the screen
+    if (forward) {
+        tty_move_to(0, top);
+        tty_delete_lines(n);
+        if (!to_end) {
+            tty_move_to(0, bottom + 1 - n);
+            tty_insert_lines(n);
+        }
+    }
+    else {
+        if (!to_end) {
+            tty_move_to(0, bottom + 1 - n);
+            tty_delete_lines(n);
+        }
+        tty_move_to(0, top);
+        tty_insert_lines(n);
+    }
+    return true;
+}
+
+/* Scroll rows top to bottom by n, up if forward, and move the front buffer to match.
+ * Returns false if the terminal can't.
+ */
+static bool tty_screen_scroll_region__(size_t top, size_t bottom, size_t n, bool forward)
+{
+    bool full = !top && bottom == scr__.h - 1;
+    cap* scroll = forward ? &tcaps.scroll_forward : &tcaps.scroll_reverse;
+
+    // on terminals with bce, lines scrolled in are filled with the current background
+    tty_set_style((tty_style){.fg = TTY_COLOR_DEFAULT, .bg = TTY_COLOR_DEFAULT});
+    if (scroll->len && (full || tcaps.scroll_region.len)) {
+        if (!full)
+            tty_send_parm(&tcaps.scroll_region, (int[]){(int)top, (int)bottom}, 2);
+        tty_move_to(0, forward ? bottom : top);
+        tty_send_n(scroll, n);
+        if (!full)
+            tty_send_parm(&tcaps.scroll_region, (int[]){0, (int)scr__.h - 1}, 2);
+    }
+    else if (!tty_screen_scroll_lines__(top, bottom, n, forward)) {
+        return false;
+    }
+
+    size_t w = scr__.w;
+    size_t moved = bottom - top + 1 - n;
+    size_t dst = forward ? top : top + n;
+    size_t src = forward ? top + n : top;
+    size_t exposed = forward ? bottom + 1 - n : top;
+    memmove(&scr__.front[dst * w], &scr__.front[src * w], moved * w * sizeof(tty_cell));
+    for (size_t i = exposed * w; i < (exposed + n) * w; ++i) {
+        scr__.front[i] = TTY_CELL_BLANK__;
+    }
+    if (forward) {
+        for (size_t y = top; y < top + moved; ++y) {
+            scr__.rows[y].front_hash = scr__.rows[y + n].front_hash;
+        }
+    }
+    else {
+        for (size_t y = bottom; y >= top + n; --y) {
+            scr__.rows[y].front_hash = scr__.rows[y - n].front_hash;
+        }
+    }
+    for (size_t y = top; y <= bottom; ++y) {
+        if (y >= exposed && y < exposed + n)
+            scr__.rows[y].front_hash = scr__.blank_hash;
+        // the rows now on the terminal may not match the back buffer anymore
+        scr__.rows[y].dirty = true;
+    }
+    return true;
+}
+
+/* Scroll blocks of rows that moved into place, so only the lines scrolled in have to be drawn */
+static void tty_screen_scroll__(void)
+{
+    for (size_t i = 0; i < scr__.h; ++i) {
+        tty_scroll__ s = tty_screen_find_scroll__();
+        // scrolling costs a few sequences, worth it once it saves redrawing more than a row
+        if (s.gain < 2)
+            return;
+
+        bool ok;
+        if (s.shift > 0)
+            ok = tty_screen_scroll_region__(s.start, s.start + s.len + (size_t)s.shift - 1, (size_t)s.shift, true);
+        else
+            ok = tty_screen_scroll_region__(s.start - (size_t)-s.shift, s.start + s.len - 1, (size_t)-s.shift, false);
+        if (!ok)
+            return;
+    }
+}
+
+void tty_screen_set_backlog(size_t bytes)
+{
+    scr_backlog__ = bytes;
+}
+
+bool tty_screen_backlogged(void)
+{
+    return scr_backlog__ && (tty_output_pending() > scr_backlog__ || !tty_output_ready());
+}
+
+int tty_present(void)
+{
+    if (!scr__.back)
+        return 1;
+    if (tty_get_size_generation() != scr__.gen && tty_screen_alloc__())
+        return 1;
+    // the terminal is behind, anything drawn now would only be shown late. The rows stay dirty, so the next present
+    // draws the newest state against what was already sent.
+    if (tty_screen_backlogged())
+        return TTYSCREEN_SKIPPED;
+
+    // the whole frame goes out in one write, drawn at once by terminals with synchronized output
+    tty_begin_frame();
+
+    if (scr__.full) {
+        // clearing sets every cell to a blank in the default style, only the other cells need to be written
+        tty_set_style((tty_style){.fg = TTY_COLOR_DEFAULT, .bg = TTY_COLOR_DEFAULT});
+        tty_send(&tcaps.scr_clr);
+        for (size_t i = 0; i < scr__.w * scr__.h; ++i) {
+            scr__.front[i] = TTY_CELL_BLANK__;
+        }
+        for (size_t y = 0; y < scr__.h; ++y) {
+            scr__.rows[y].front_hash = scr__.blank_hash;
+        }
+        tty_rows_dirty__();
+        scr__.full = false;
+    }
+
+    bool changed = false;
+    for (size_t y = 0; y < scr__.h; ++y) {
+        tty_row__* row = &scr__.rows[y];
+        if (row->dirty) {
+            row->back_hash = tty_row_hash__(&scr__.back[y * scr__.w], scr__.w);
+            changed |= row->back_hash != row->front_hash;
+        }
+    }
+    if (changed)
+        tty_screen_scroll__();
+
+    // where the cursor is after the cells written so far, SIZE_MAX when it has to be moved
+    size_t cur_x = SIZE_MAX;
+    size_t cur_y = SIZE_MAX;
+    const tty_cell* last = NULL;
+    // writing the last cell on terminals that wrap right away would scroll the screen
+    bool skip_last = tcaps.auto_right_margin && !tcaps.eat_newline_glitch;
+
+    for (size_t y = 0; y < scr__.h; ++y) {
+        tty_row__* row = &scr__.rows[y];
+        if (!row->dirty)
+            continue;
+        row->dirty = false;
+
+        tty_cell* front = &scr__.front[y * scr__.w];
+        tty_cell* back = &scr__.back[y * scr__.w];
+        size_t x = tty_row_diff__(front, back, scr__.w);
+        if (x == scr__.w)
+            continue;
+
+        for (; x < scr__.w; x += tty_row_diff__(&front[x + 1], &back[x + 1], scr__.w - x - 1) + 1) {
+            if (skip_last && y == scr__.h - 1 && x == scr__.w - 1) {
+                row->dirty = true; // still differs, keep trying
+                continue;
+            }
+
+            if (cur_y != y || cur_x != x) {
+                if (cur_y != y || cur_x > x || !last || !tty_screen_overwrite__(y, cur_x, x, last))
+                    tty_move_to(x, y);
+            }
+
+            tty_set_style(tty_cell_style__(&back[x]));
+            tty_write(back[x].glyph, back[x].len);
+            front[x] = back[x];
+            last = &front[x];
+            cur_x = x + 1 < scr__.w ? x + 1 : SIZE_MAX;
+            cur_y = y;
+        }
+        row->front_hash = row->dirty ? tty_row_hash__(front, scr__.w) : row->back_hash;
+    }
+
+    return tty_end_frame();
+}
+
+/* Render scheduler: tty_invalidate marks the screen dirty, tty_render presents at most frame_rate times a second */
+typedef struct {
+    long dirty; /* set by tty_invalidate, atomically */
+    unsigned frame_rate;
+    int64_t last; /* when the last frame was presented, in ms */
+    tty_render_callback callback;
+    void* data;
+#if !defined(_WIN32) && !defined(_WIN64)
+    int wake[2]; /* becomes readable when the screen is invalidated, see tty_render_fd */
+#endif /* if !defined(_WIN32) && !defined(_WIN64) */
+} tty_scheduler__;
+
+static tty_scheduler__ sched__ = {.frame_rate = TTYSCREEN_FRAME_RATE,
+                                  .last = INT64_MIN / 2,
+#if !defined(_WIN32) && !defined(_WIN64)
+                                  .wake = {-1, -1}
+#endif /* if !defined(_WIN32) && !defined(_WIN64) */
+};
+
+/* 64 bits, long is 32 on Windows and 32-bit Linux and would wrap after 24.8 days of uptime */
+static int64_t tty_sched_now_ms__(void)
+{
+#if !defined(_WIN32) && !defined(_WIN64)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#else
+    return (int64_t)GetTickCount64();
+#endif /* if !defined(_WIN32) && !defined(_WIN64) */
+}
+
+void tty_set_render_callback(tty_render_callback callback, void* data)
+{
+    sched__.callback = callback;
+    sched__.data = data;
+}
+
+void tty_set_frame_rate(unsigned frame_rate)
+{
+    sched__.frame_rate = frame_rate ? frame_rate : TTYSCREEN_FRAME_RATE;
+}
+
+void tty_invalidate(void)
+{
+    if (tty_atomic_xchg__(&sched__.dirty, 1))
+        return;
+#if !defined(_WIN32) && !defined(_WIN64)
+    // only on the first invalidate since the last frame, so the pipe never fills up
+    if (sched__.wake[1] != -1) {
+        ssize_t rc;
+        do {
+            rc = write(sched__.wake[1], "", 1);
+        } while (rc == -1 && errno == EINTR);
+    }
+#endif /* if !defined(_WIN32) && !defined(_WIN64) */
+}
+
+#if !defined(_WIN32) && !defined(_WIN64)
+int tty_render_fd(void)
+{
+    if (sched__.wake[0] != -1)
+        return sched__.wake[0];
+    if (pipe(sched__.wake))
+        return -1;
+    for (int i = 0; i < 2; ++i) {
+        fcntl(sched__.wake[i], F_SETFL, fcntl(sched__.wake[i], F_GETFL) | O_NONBLOCK);
+        fcntl(sched__.wake[i], F_SETFD, FD_CLOEXEC);
+    }
+    // already invalidated before anyone was listening, wake the first poll
+    if (tty_atomic_load__(&sched__.dirty))
+        (void)!write(sched__.wake[1], "", 1);
+    return sched__.wake[0];
+}
+#endif /* if !defined(_WIN32) && !defined(_WIN64) */
+
+int tty_render(void)
+{
+    if (!tty_atomic_load__(&sched__.dirty))
+        return -1;
+    // drained even when the frame is put off, the dirty flag keeps it pending and the returned timeout wakes the loop
+#if !defined(_WIN32) && !defined(_WIN64)
+    if (sched__.wake[0] != -1) {
+        char buf[16];
+        while (read(sched__.wake[0], buf, sizeof(buf)) > 0)
+            ;
+    }
+#endif /* if !defined(_WIN32) && !defined(_WIN64) */
+
+    // the first change after an idle gap is drawn right away, changes within a frame are coalesced into the next one
+    int64_t now = tty_sched_now_ms__();
+    int64_t interval = 1000 / sched__.frame_rate;
+    int64_t wait = sched__.last + interval - now;
+    if (wait > 0)
+        return (int)wait;
+    // don't bother drawing a frame that would be skipped, try again a frame later
+    if (tty_screen_backlogged())
+        return (int)(interval ? interval : 1);
+
+    // cleared before drawing, so changes made while drawing get a frame of their own
+    tty_atomic_xchg__(&sched__.dirty, 0);
+    sched__.last = now;
+    if (sched__.callback)
+        sched__.callback(sched__.data);
+    tty_present();
+    return -1;
+}
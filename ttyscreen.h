@@ -0,0 +1,102 @@
+/* Copyright ttyio (C) by Alex Eski 2025 */
+/* Licensed under GPLv3, see LICENSE for more information. */
+/* ttyscreen.h: optional double-buffered screen layer for the ttyio library */
+
+#ifndef TTYSCREEN_GUARD_H_
+#define TTYSCREEN_GUARD_H_
+
+#include "ttyio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+/* A cell on the screen: one UTF-8 encoded glyph and its style.
+ * Every glyph takes up one column, wide characters aren't supported.
+ */
+typedef struct {
+    char glyph[4];
+    unsigned char len;
+    unsigned char attrs; // enum tty_attr flags
+    unsigned char reserved[2]; // always 0, cells are compared byte for byte
+    int fg;
+    int bg;
+} tty_cell;
+
+/* Apps draw into the back buffer, then tty_present writes only the cells that differ from what is on the terminal
+ * (the front buffer). The screen is sized to the terminal and follows it when it is resized.
+ */
+int tty_screen_init(void);
+void tty_screen_deinit(void);
+
+/* Size of the back buffer, the size of the terminal as of the last tty_screen_init or tty_present */
+Coordinates tty_screen_size(void);
+
+/* Clear the back buffer to spaces with the default colors */
+void tty_screen_clear(void);
+/* Set one cell, x and y are 0 based. Cells outside the screen are ignored. */
+void tty_screen_put(size_t x, size_t y, const char* restrict glyph, size_t len, tty_style style);
+/* Write a UTF-8 string starting at x, y. Stops at the end of the row. Returns the number of cells written. */
+size_t tty_screen_print(size_t x, size_t y, tty_style style, const char* restrict str);
+/* Fill a rectangle with one glyph and style */
+void tty_screen_fill(size_t x, size_t y, size_t w, size_t h, const char* restrict glyph, size_t len, tty_style style);
+/* Copy a rectangle of cells to column to_x and row to_y, e.g. to scroll a pane sideways or move a window.
+ * The rectangles can overlap. On terminals known to have rectangular editing (see tty_detect_rect_ops) the terminal
+ * copies the cells too (tty_copy_rect), so the next present doesn't have to redraw them. Outputs right away, unlike
+ * the other drawing functions, except while tty_screen_backlogged, when the next present redraws them instead.
+ */
+void tty_screen_copy(size_t x, size_t y, size_t w, size_t h, size_t to_x, size_t to_y);
+
+/* Write the cells that changed since the last present to the terminal as one frame, see tty_begin_frame.
+ * Returns 0, 1 on error, TTY_PENDING when part of the frame is still queued (see tty_flush), or TTYSCREEN_SKIPPED when
+ * the frame was skipped because the terminal is backlogged.
+ */
+int tty_present(void);
+
+/* Backpressure: when the terminal or the connection to it is slower than the output, frames pile up in the tty driver
+ * and what is shown lags further and further behind. While more than the backlog limit of output hasn't reached the
+ * terminal (tty_output_pending), or the terminal can't take more output at all (tty_output_ready), tty_present skips
+ * frames. Once it catches up, only the newest state is drawn.
+ * Works best with tty_set_nonblocking, so writing a frame never blocks either.
+ */
+#define TTYSCREEN_BACKLOG 16384
+#define TTYSCREEN_SKIPPED 3
+
+/* Bytes of pending output to start skipping frames at, 0 to never skip */
+void tty_screen_set_backlog(size_t bytes);
+bool tty_screen_backlogged(void);
+/* Forget what is on the terminal, so the next tty_present redraws everything.
+ * Call after writing to the terminal without the screen layer.
+ */
+void tty_screen_invalidate(void);
+
+/* Render scheduling: instead of presenting after every change, apps call tty_invalidate when something changed and
+ * tty_render from their loop. Changes are coalesced, so the screen is presented at most frame rate times a second,
+ * however often tty_invalidate is called. The first change after an idle gap is presented right away.
+ */
+#define TTYSCREEN_FRAME_RATE 60
+
+typedef void (*tty_render_callback)(void* data);
+
+/* Called by tty_render right before tty_present, to draw the back buffer. Optional, apps can also draw as they go. */
+void tty_set_render_callback(tty_render_callback callback, void* data);
+/* Presents per second, 0 sets the default, TTYSCREEN_FRAME_RATE */
+void tty_set_frame_rate(unsigned frame_rate);
+/* Mark the screen as needing a present. Cheap, can be called from any thread and as often as needed. */
+void tty_invalidate(void);
+/* Present if the screen was invalidated and a frame is due. Returns how many ms until the next frame is due when one is
+ * pending but it is too early, so it can be used as a poll timeout, or -1 when there is nothing to present.
+ */
+int tty_render(void);
+#if !defined(_WIN32) && !defined(_WIN64)
+/* A file descriptor that becomes readable when the screen is invalidated, to wake up a poll/select loop that
+ * is waiting on input. tty_render drains it. Returns -1 on error.
+ */
+int tty_render_fd(void);
+#endif /* if !defined(_WIN32) && !defined(_WIN64) */
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#endif /* !TTYSCREEN_GUARD_H_ */